@@ -8,6 +8,9 @@
 
 #include <iostream>
 #include <chrono>
+#include <cmath>
+#include <sstream>
+#include <thread>
 #include <omp.h>
 
 #include <ciccio-s.hpp>
@@ -27,9 +30,11 @@ using SU3bComps=
 PROVIDE_ASM_DEBUG_HANDLE(sumProd,CpuSU3Field<float,StorLoc::ON_CPU>*);
 PROVIDE_ASM_DEBUG_HANDLE(sumProd,GpuSU3Field<float,StorLoc::ON_GPU>*);
 PROVIDE_ASM_DEBUG_HANDLE(sumProd,SimdSU3Field<float,StorLoc::ON_CPU>*);
+PROVIDE_ASM_DEBUG_HANDLE(sumProd,CpuSU3Field<float,StorLoc::ON_FILE>*);
 PROVIDE_ASM_DEBUG_HANDLE(sumProd,CpuSU3Field<double,StorLoc::ON_CPU>*);
 PROVIDE_ASM_DEBUG_HANDLE(sumProd,GpuSU3Field<double,StorLoc::ON_GPU>*);
 PROVIDE_ASM_DEBUG_HANDLE(sumProd,SimdSU3Field<double,StorLoc::ON_CPU>*);
+PROVIDE_ASM_DEBUG_HANDLE(sumProd,CpuSU3Field<double,StorLoc::ON_FILE>*);
 
 PROVIDE_ASM_DEBUG_HANDLE(sumProd,Tens<SU3FieldComps,float,StorLoc::ON_CPU>*);
 PROVIDE_ASM_DEBUG_HANDLE(sumProd,Tens<SU3FieldComps,double,StorLoc::ON_CPU>*);
@@ -213,10 +218,11 @@ void test(const int vol,         ///< Volume to simulate
   
   LOGGER<<"Volume: "<<vol<<" dataset: "<<3*(double)vol*sizeof(SU3<Complex<Fund>>)/(1<<20)<<endl;
   
-  // Loop over three different layout and storage
+  // Loop over different layout and storage
   forEachInTuple(std::tuple<
 		 SimdSU3Field<Fund,StorLoc::ON_CPU>*,
 		 CpuSU3Field<Fund,StorLoc::ON_CPU>*,
+		 CpuSU3Field<Fund,StorLoc::ON_FILE>*,
 		 GpuSU3Field<Fund,StorLoc::ON_GPU>*>{},
 		 [&](auto t)
 		 {
@@ -248,14 +254,14 @@ INLINE_FUNCTION void su3FieldsSumProd(F1& field1,const F2& field2,const F3& fiel
 			  // the compiler implementation
 			  BOOKMARK_BEGIN_sumProd((F1*){});
 			  
-			  /// Take access to the looping site, so the
+			  /// Take a cursor on the looping site, so the
 			  /// compiler needs not to recompute the full
-			  /// index for each color components, and it has a
-			  /// clearer view which makes it easier to produce
-			  /// optimized code
-			  auto f1=field1[iSite].carryOver().simdify();
-			  auto f2=field2[iSite].carryOver().simdify();
-			  auto f3=field3[iSite].carryOver().simdify();
+			  /// index for each color components: the offset
+			  /// of each of them is a constant added to the
+			  /// pointer
+			  auto f1=field1[iSite].carryOver().simdify().cursor();
+			  const auto f2=field2[iSite].carryOver().simdify().cursor();
+			  const auto f3=field3[iSite].carryOver().simdify().cursor();
 			  
 			  // Tens<SU3Comps,typename F1::Fund,StorLoc::ON_CPU,false> f1(&field1[iSite][clRow(0)][clCln(0)][complComp(RE)]);
 			  // const Tens<SU3Comps,typename F2::Fund,StorLoc::ON_CPU,false> f2(&field2[iSite][clRow(0)][clCln(0)][complComp(RE)]);
@@ -275,19 +281,19 @@ INLINE_FUNCTION void su3FieldsSumProd(F1& field1,const F2& field2,const F3& fiel
 			      // imaginay part
 			      
 			      /// Result real and imaginary part
-			      auto f1c=f1[clRow(i)][clCln(j)];
-			      auto f1r=f1c[complComp(RE)];
-			      auto f1i=f1c[complComp(IM)];
+			      auto f1c=f1.moved(clRow(i),clCln(j));
+			      auto& f1r=f1c(complComp(RE));
+			      auto& f1i=f1c(complComp(IM));
 			     
 			     /// First operand, real and imaginary
-			     const auto f2c=f2[clRow(i)][clCln(k)];
-			     const auto& f2r=f2c[complComp(RE)];
-			     const auto& f2i=f2c[complComp(IM)];
+			     const auto f2c=f2.moved(clRow(i),clCln(k));
+			     const auto& f2r=f2c(complComp(RE));
+			     const auto& f2i=f2c(complComp(IM));
 			     
 			     /// Second operand, real and imaginary
-			     const auto f3c=f3[clRow(k)][clCln(j)];
-			     const auto& f3r=f3c[complComp(RE)];
-			     const auto& f3i=f3c[complComp(IM)];
+			     const auto f3c=f3.moved(clRow(k),clCln(j));
+			     const auto& f3r=f3c(complComp(RE));
+			     const auto& f3i=f3c(complComp(IM));
 			     
 			     // Adds the real part
 			     f1r+=f2r*f3r;
@@ -557,6 +563,1303 @@ void mp2(Tens<TensComps<SpinRow,SpinCln,Compl>,double,StorLoc::ON_CPU>& a2,
   LOGGER<<a2b2[o][p][RE]<<endl;
 }
 
+/// Measure the overhead of launching a parallel loop on a small volume
+void testLaunchOverhead(const int vol,         ///< Volume of the loop
+			const int workReducer) ///< Reduce worksize to make a quick test
+{
+  /// Number of launches
+  const int64_t nLaunches=1000000/workReducer;
+  
+  /// Data written by the loop, to check it is actually run
+  std::vector<double> data(vol,0.0);
+  
+  /// Pointer to the data, the only capture of the kernel
+  double* d=data.data();
+  
+  /// Takes note of starting moment
+  const Instant start=takeTime();
+  
+  for(int64_t i=0;i<nLaunches;i++)
+    ThreadPool::loopSplit(0,vol,[d](const int& iSite)
+				{
+				  d[iSite]+=1.0;
+				});
+  ThreadPool::waitThatAllWorkersWaitForWork();
+  
+  /// Takes note of ending moment
+  const Instant end=takeTime();
+  
+  // Let the loop decide how many threads to use
+  for(int64_t i=0;i<nLaunches;i++)
+    ThreadPool::loopSplit(0,vol,[d](const int& iSite)
+				{
+				  d[iSite]+=1.0;
+				},ThreadPool::LoopSchedule().adaptively());
+  ThreadPool::waitThatAllWorkersWaitForWork();
+  
+  /// Takes note of ending moment of the adaptive loops
+  const Instant endAdaptive=takeTime();
+  
+  // Run the same loops inside a single parallel region
+  ThreadPool::region([d,vol,nLaunches](ThreadPool::Team& team)
+		     {
+		       for(int64_t i=0;i<nLaunches;i++)
+			 {
+			   team.loop(0,vol,[d](const int& iSite)
+					   {
+					     d[iSite]+=1.0;
+					   });
+			   team.barrier();
+			 }
+		     });
+  
+  /// Takes note of ending moment of the region
+  const Instant endRegion=takeTime();
+  
+  LOGGER<<"Volume: "<<vol<<" launch overhead: "<<timeDiffInSec(end,start)/nLaunches*1e6<<" us,"
+    " adaptive: "<<timeDiffInSec(endAdaptive,end)/nLaunches*1e6<<" us,"
+    " inside a region: "<<timeDiffInSec(endRegion,endAdaptive)/nLaunches*1e6<<" us\t Check: "<<data[vol-1]<<" "<<3*nLaunches<<endl;
+}
+
+/// Check the assignment of the iterations of a loop to the threads
+void testLoopSplitLayout()
+{
+  /// Length of the loop
+  const int length=1000;
+  
+  /// System identifier of each thread of the pool
+  std::vector<std::thread::id> threadIds(nThreads);
+  
+  ThreadPool::parallel([&threadIds](const int& threadId)
+		       {
+			 threadIds[threadId]=std::this_thread::get_id();
+		       });
+  ThreadPool::waitThatAllWorkersWaitForWork();
+  
+  /// System identifier of the thread which has run each iteration
+  std::vector<std::thread::id> runBy(length);
+  
+  // By default each thread runs its own contiguous chunk, as if the loop was not adaptive
+  ThreadPool::loopSplit(0,length,[&runBy](const int& i)
+				 {
+				   runBy[i]=std::this_thread::get_id();
+				 });
+  ThreadPool::waitThatAllWorkersWaitForWork();
+  
+  for(int threadId=0;threadId<nThreads;threadId++)
+    {
+      /// Chunk expected to be run by the thread
+      const std::pair<int,int> chunk=
+	ThreadPool::getStaticChunk(0,length,threadId,nThreads);
+      
+      for(int i=chunk.first;i<chunk.second;i++)
+	if(runBy[i]!=threadIds[threadId])
+	  CRASHER<<"Iteration "<<i<<" of the default loop not run by thread "<<threadId<<endl;
+    }
+  
+  // A loop asking to adapt, too cheap to be worth the dispatch, is run by the master
+  ThreadPool::loopSplit(0,length,[&runBy](const int& i)
+				 {
+				   runBy[i]=std::this_thread::get_id();
+				 },ThreadPool::LoopSchedule().withCostPerIteration(1e-12));
+  ThreadPool::waitThatAllWorkersWaitForWork();
+  
+  if(ThreadPool::useAdaptiveLoopSplit)
+    for(int i=0;i<length;i++)
+      if(runBy[i]!=threadIds[masterThreadId])
+	CRASHER<<"Iteration "<<i<<" of the cheap adaptive loop not run by the master thread"<<endl;
+  
+  LOGGER<<"Assignment of the loop iterations to the threads verified"<<endl;
+}
+
+/// Measure the latency of a barrier among the given number of threads
+template <typename Barrier>
+double barrierLatency(const int nParticipants, ///< Number of threads taking part to the barrier
+		      const int64_t nIters)    ///< Number of barriers to be passed
+{
+  /// Barrier to be tested
+  Barrier barrier(nParticipants);
+  
+  /// Takes note of starting moment
+  const Instant start=takeTime();
+  
+  ThreadPool::parallel([&barrier,nParticipants,nIters](const int& threadId)
+		       {
+			 if(threadId<nParticipants)
+			   for(int64_t i=0;i<nIters;i++)
+			     barrier.wait(threadId);
+		       });
+  ThreadPool::waitThatAllWorkersWaitForWork();
+  
+  /// Takes note of ending moment
+  const Instant end=takeTime();
+  
+  return timeDiffInSec(end,start)/nIters;
+}
+
+/// Compare the latency of the barriers, and of a dispatch and join of the pool
+void testBarrierLatency(const int workReducer) ///< Reduce worksize to make a quick test
+{
+  /// Number of barriers passed
+  const int64_t nIters=100000/workReducer;
+  
+  for(int nParticipants=2;nParticipants<=nThreads;nParticipants++)
+    LOGGER<<"Threads: "<<nParticipants<<
+      " central barrier latency: "<<barrierLatency<ThreadPool::CentralBarrier>(nParticipants,nIters)*1e6<<" us,"
+      " dissemination barrier latency: "<<barrierLatency<ThreadPool::DisseminationBarrier>(nParticipants,nIters)*1e6<<" us"<<endl;
+  
+  /// Takes note of starting moment
+  const Instant start=takeTime();
+  
+  for(int64_t i=0;i<nIters;i++)
+    {
+      ThreadPool::parallel([](const int&){});
+      ThreadPool::waitThatAllWorkersWaitForWork();
+    }
+  
+  /// Takes note of ending moment
+  const Instant end=takeTime();
+  
+  LOGGER<<"Threads: "<<nThreads<<" pool dispatch and join latency: "<<timeDiffInSec(end,start)/nIters*1e6<<" us"<<endl;
+}
+
+/// Number of works profiled on each thread, recorded or dropped
+std::vector<int64_t> nProfiledWorksPerThread()
+{
+  /// Result
+  std::vector<int64_t> res(nThreads);
+  
+  for(int threadId=0;threadId<nThreads;threadId++)
+    {
+      /// Records of the thread
+      const ThreadPool::WorkRecordBuffer& buffer=
+	ThreadPool::resources::workRecords[threadId];
+      
+      res[threadId]=buffer.records.size()+buffer.nDropped;
+    }
+  
+  return res;
+}
+
+/// Run the same kernels with each backend of the pool, check the results and compare the timings
+void testBackends(const int workReducer) ///< Reduce worksize to make a quick test
+{
+  /// Number of launches on a small volume
+  const int64_t nLaunches=100000/workReducer;
+  
+  /// Volume of the small loop
+  const int smallVol=256;
+  
+  /// Volume of the large loops
+  const int largeVol=(1<<22)/workReducer;
+  
+  /// Number of repetitions of the large loops
+  const int nReps=10;
+  
+  /// Data of the loops
+  std::vector<double> a(largeVol),b(largeVol,1.0),c(largeVol,2.0);
+  
+  /// Pointers to the data, captured by the kernels
+  double* pa=a.data();
+  const double* pb=b.data();
+  const double* pc=c.data();
+  
+  /// Backends to be tested, the OpenMP one only with the detached pool
+  std::vector<std::string> backendNames{"spin","condvar"};
+  if(useDetachedPool)
+    backendNames.push_back("openmp");
+  
+  for(const std::string& backendName : backendNames)
+    {
+      ThreadPool::setBackend(ThreadPool::makeBackend(backendName));
+      std::fill(a.begin(),a.end(),0.0);
+      
+      /// Takes note of starting moment
+      const Instant start=takeTime();
+      
+      for(int64_t i=0;i<nLaunches;i++)
+	ThreadPool::loopSplit(0,smallVol,[pa](const int& iSite)
+					 {
+					   pa[iSite]+=1.0;
+					 });
+      ThreadPool::waitThatAllWorkersWaitForWork();
+      
+      /// Takes note of ending moment of the small loops
+      const Instant endSmall=takeTime();
+      
+      for(int iSite=0;iSite<smallVol;iSite++)
+	if(a[iSite]!=nLaunches)
+	  CRASHER<<"Backend "<<backendName<<": site "<<iSite<<" of the small loop updated "<<a[iSite]<<" times instead of "<<nLaunches<<endl;
+      
+      /// Number of works profiled before the triad
+      const std::vector<int64_t> nProfiledBefore=
+	nProfiledWorksPerThread();
+      
+      for(int iRep=0;iRep<nReps;iRep++)
+	ThreadPool::loopSplit(0,largeVol,[pa,pb,pc](const int& iSite)
+					 {
+					   pa[iSite]=pb[iSite]+0.5*pc[iSite];
+					 });
+      ThreadPool::waitThatAllWorkersWaitForWork();
+      
+      /// Takes note of ending moment of the triad
+      const Instant endTriad=takeTime();
+      
+      // Each thread must have profiled each repetition of the triad
+      if(ThreadPool::useWorkProfiling)
+	{
+	  /// Number of works profiled after the triad
+	  const std::vector<int64_t> nProfiledAfter=
+	    nProfiledWorksPerThread();
+	  
+	  for(int threadId=0;threadId<nThreads;threadId++)
+	    if(nProfiledAfter[threadId]-nProfiledBefore[threadId]!=nReps)
+	      CRASHER<<"Backend "<<backendName<<": thread "<<threadId<<" profiled "<<nProfiledAfter[threadId]-nProfiledBefore[threadId]<<" works instead of "<<nReps<<endl;
+	}
+      
+      /// Result of the reduction
+      double sum=0;
+      
+      for(int iRep=0;iRep<nReps;iRep++)
+	sum+=ThreadPool::loopReduce(0,largeVol,0.0,
+				    [pa](const int& iSite)
+				    {
+				      return pa[iSite];
+				    },
+				    [](const double& x,const double& y)
+				    {
+				      return x+y;
+				    });
+      
+      /// Takes note of ending moment of the reduction
+      const Instant endReduce=takeTime();
+      
+      if(sum!=nReps*largeVol*2.0)
+	CRASHER<<"Backend "<<backendName<<": reduction gave "<<sum<<" instead of "<<nReps*largeVol*2.0<<endl;
+      
+      std::fill(a.begin(),a.begin()+smallVol,0.0);
+      
+      /// Number of times a thread has seen a site not yet updated by another thread after the barrier
+      std::atomic<int64_t> nBarrierErrors(0);
+      
+      // Loops inside a single region, synchronized with barriers
+      ThreadPool::region([pa,nLaunches,smallVol,&nBarrierErrors](ThreadPool::Team& team)
+			 {
+			   for(int64_t i=0;i<nLaunches;i++)
+			     {
+			       team.loop(0,smallVol,[pa](const int& iSite)
+						    {
+						      pa[iSite]+=1.0;
+						    });
+			       team.barrier();
+			       
+			       // The site read is updated by another thread
+			       if(pa[smallVol-1-team.getThreadId()]!=i+1)
+				 nBarrierErrors++;
+			       team.barrier();
+			     }
+			 });
+      
+      /// Takes note of ending moment of the region
+      const Instant endRegion=takeTime();
+      
+      if(nBarrierErrors)
+	CRASHER<<"Backend "<<backendName<<": "<<nBarrierErrors<<" sites read before being updated in the region"<<endl;
+      
+      /// Bandwidth of the triad, in GB/s
+      const double triadBandwidth=
+	3.0*sizeof(double)*largeVol*nReps/timeDiffInSec(endTriad,endSmall)/1e9;
+      
+      LOGGER<<"Backend: "<<ThreadPool::getBackend().name()<<
+	" small loop: "<<timeDiffInSec(endSmall,start)/nLaunches*1e6<<" us,"
+	" triad: "<<triadBandwidth<<" GB/s,"
+	" reduction: "<<timeDiffInSec(endReduce,endTriad)/nReps*1e3<<" ms,"
+	" loop and barrier in a region: "<<timeDiffInSec(endRegion,endReduce)/nLaunches*1e6<<" us"<<endl;
+    }
+  
+  ThreadPool::setBackend(ThreadPool::makeBackend(ThreadPool::backendName));
+}
+
+/// Check that the temporaries of a kernel are taken from the scratch arena, or from the memory manager when not possible
+void testScratchArena()
+{
+  /// Type of a temporary which might go on the arena
+  using Temp=
+    Tens<TensComps<SpaceTime,ColRow,ColCln,Compl>,double,StorLoc::ON_CPU,Stackable::MIGHT_GO_ON_STACK_ELSE_ON_ARENA>;
+  
+  /// Number of sites of the temporaries
+  const int nSites=64;
+  
+  /// Size of a temporary, in bytes
+  const int64_t tempSize=
+    sizeof(double)*nSites*NColComp*NColComp*2;
+  
+  /// Length of the loop
+  const int length=1000;
+  
+  /// Number of iterations whose temporary has not been taken from the arena of the thread
+  std::atomic<int> nNotOnArena(0);
+  
+  /// Number of iterations finding the memory of the previous iterations not given back
+  std::atomic<int> nNotRewound(0);
+  
+  ThreadPool::loopSplit(0,length,[&nNotOnArena,&nNotRewound,nSites,tempSize](const int& i)
+				 {
+				   /// Temporary of the iteration
+				   Temp temp(spaceTime(nSites));
+				   
+				   if(not scratchArena().contains(temp.getDataPtr()))
+				     nNotOnArena++;
+				   
+				   if(scratchArena().getOffset()>tempSize+CACHE_LINE_SIZE)
+				     nNotRewound++;
+				 });
+  ThreadPool::waitThatAllWorkersWaitForWork();
+  
+  if(nNotOnArena or nNotRewound)
+    CRASHER<<"Out of "<<length<<" iterations, "<<nNotOnArena<<" did not take the temporary from the arena, "<<nNotRewound<<" found the arena not rewound"<<endl;
+  
+  if(scratchArena().getOffset()!=0)
+    CRASHER<<"Arena not given back at the end of the loop, "<<scratchArena().getOffset()<<" bytes still used"<<endl;
+  
+  /// Temporary created outside any scope
+  Temp outside(spaceTime(nSites));
+  
+  if(scratchArena().contains(outside.getDataPtr()))
+    CRASHER<<"Temporary created outside any scope taken from the arena"<<endl;
+  
+  {
+    /// Scope in which the temporary does not fit the arena
+    ScratchArenaScope scope;
+    
+    /// Temporary larger than the arena
+    Temp tooLarge(spaceTime(scratchArenaSize/(sizeof(double)*NColComp*NColComp*2)+1));
+    
+    if(scratchArena().contains(tooLarge.getDataPtr()))
+      CRASHER<<"Temporary larger than the arena taken from it"<<endl;
+  }
+  
+  LOGGER<<"Scratch arena: "<<length<<" temporaries taken from the arena, maximal usage on master: "<<scratchArena().getMaxOffset()<<" bytes"<<endl;
+}
+
+/// Measure the throughput of the memory manager, with the allocation pattern of expression temporaries, from the master and from all threads
+void testMemoryManager(const int workReducer) ///< Reduce worksize to make a quick test
+{
+  /// Number of expressions evaluated
+  const int64_t nExprs=1000000/workReducer;
+  
+  /// Volume of the fields
+  const int64_t vol=4096;
+  
+  /// Number of doubles of the temporaries: SU3 matrices, color vectors and complex numbers on each site
+  const int64_t nels[]={18*vol,6*vol,2*vol};
+  
+  /// Number of different temporaries
+  const int nTemps=sizeof(nels)/sizeof(int64_t);
+  
+  /// Takes note of starting moment
+  const Instant start=takeTime();
+  
+  // Each expression allocates a few temporaries and releases them in reverse order
+  for(int64_t iExpr=0;iExpr<nExprs;iExpr++)
+    {
+      /// Temporaries of the expression
+      double* temps[nTemps];
+      
+      for(int iTemp=0;iTemp<nTemps;iTemp++)
+	temps[iTemp]=cpuMemoryManager->provide<double>(nels[(iExpr+iTemp)%nTemps]);
+      
+      for(int iTemp=nTemps-1;iTemp>=0;iTemp--)
+	cpuMemoryManager->release(temps[iTemp]);
+    }
+  
+  /// Takes note of ending moment
+  const Instant end=takeTime();
+  
+  LOGGER<<"Memory manager: "<<timeDiffInSec(end,start)/(nExprs*nTemps)*1e9<<" ns per provide and release"<<endl;
+  
+  /// Takes note of starting moment of the concurrent allocations
+  const Instant startConcurrent=takeTime();
+  
+  // Each thread allocates the temporaries of a site, checking that they are not shared
+  ThreadPool::loopSplit((int64_t)0,nExprs,
+			[&](const int64_t& iExpr)
+			{
+			  /// Temporaries of the expression
+			  double* temps[nTemps];
+			  
+			  for(int iTemp=0;iTemp<nTemps;iTemp++)
+			    {
+			      temps[iTemp]=cpuMemoryManager->provide<double>(nels[(iExpr+iTemp)%nTemps]/vol);
+			      temps[iTemp][0]=iExpr;
+			    }
+			  
+			  for(int iTemp=nTemps-1;iTemp>=0;iTemp--)
+			    {
+			      if(temps[iTemp][0]!=iExpr)
+				CRASHER<<"Temporary "<<iTemp<<" of expression "<<iExpr<<" overwritten by another thread"<<endl;
+			      
+			      cpuMemoryManager->release(temps[iTemp]);
+			    }
+			});
+  ThreadPool::waitThatAllWorkersWaitForWork();
+  
+  /// Takes note of ending moment of the concurrent allocations
+  const Instant endConcurrent=takeTime();
+  
+  LOGGER<<"Memory manager from all threads: "<<timeDiffInSec(endConcurrent,startConcurrent)/(nExprs*nTemps)*1e9<<" ns per provide and release"<<endl;
+  cpuMemoryManager->printStatistics();
+  
+  /// Another manager, used alternately with the main one
+  CPUMemoryManager otherMemoryManager;
+  
+  /// Number of caches of the threads before alternating the managers
+  const int64_t nFrontCaches=
+    cpuMemoryManager->getNFrontCaches();
+  
+  for(int iAlt=0;iAlt<4;iAlt++)
+    for(CPUMemoryManager* manager : {cpuMemoryManager,&otherMemoryManager})
+      {
+	/// Temporary taken from the manager
+	double* temp=
+	  manager->provide<double>(nels[iAlt%nTemps]/vol);
+	
+	manager->release(temp);
+      }
+  
+  if(cpuMemoryManager->getNFrontCaches()!=nFrontCaches or otherMemoryManager.getNFrontCaches()!=1)
+    CRASHER<<"Alternating two memory managers created "<<cpuMemoryManager->getNFrontCaches()-nFrontCaches<<" and "<<otherMemoryManager.getNFrontCaches()-1<<" additional caches"<<endl;
+}
+
+/// Check the budget of the shared memory cache, evicting the least recently cached memory, and the reuse of larger memory
+void testMemoryCacheBudget()
+{
+  /// Budget set through the flag, restored at the end
+  const Size origMemoryCacheBudget=memoryCacheBudget;
+  
+  /// Size of a memory, large enough to skip the caches of the threads
+  const Size size=
+    1<<22;
+  
+  memoryCacheBudget=3*size;
+  
+  // Releases must not be deferred
+  ThreadPool::waitWorksInFlight();
+  
+  /// Manager used only for the test
+  CPUMemoryManager manager;
+  
+  /// Memory cached first, to be evicted
+  char* first=
+    manager.provide<char>(size);
+  
+  /// Memory twice as large, cached second
+  char* second=
+    manager.provide<char>(2*size);
+  
+  /// Memory cached last
+  char* last=
+    manager.provide<char>(size);
+  
+  /// Copies of the pointers, which are reset by the release
+  char* const secondCopy=second;
+  char* const lastCopy=last;
+  
+  manager.release(first);
+  manager.release(second);
+  
+  if(manager.getNEvictions()!=0)
+    CRASHER<<"Memory evicted before exceeding the budget"<<endl;
+  
+  manager.release(last);
+  
+  if(manager.getNEvictions()!=1)
+    CRASHER<<"Expected 1 eviction when exceeding the budget, obtained "<<manager.getNEvictions()<<endl;
+  
+  // The least recently cached memory must have been evicted, the others must be reused
+  second=manager.provide<char>(2*size);
+  last=manager.provide<char>(size);
+  
+  if(second!=secondCopy or last!=lastCopy)
+    CRASHER<<"Memory cached after the evicted one not reused"<<endl;
+  
+  if(manager.getNCachedReused()!=2)
+    CRASHER<<"Expected 2 reuses, obtained "<<manager.getNCachedReused()<<endl;
+  
+  manager.release(last);
+  
+  /// Memory slightly smaller than the cached one, which can be reused wasting less than the allowed fraction
+  char* smaller=
+    manager.provide<char>(size-size/8);
+  
+  if(smaller!=lastCopy or manager.getNBestFitReused()!=1)
+    CRASHER<<"Cached memory of a larger class not reused"<<endl;
+  
+  manager.release(smaller);
+  
+  /// Memory larger than the whole budget, which must not be cached
+  char* huge=
+    manager.provide<char>(4*size);
+  
+  manager.release(huge);
+  
+  if(manager.getNEvictions()!=2)
+    CRASHER<<"Memory larger than the budget has been cached"<<endl;
+  
+  manager.release(second);
+  manager.printStatistics();
+  
+  memoryCacheBudget=origMemoryCacheBudget;
+}
+
+/// Check the report of the sites of the allocations, with the sizes at the peak of the used memory
+void testMemoryReport()
+{
+  /// Tracking set through the flag, restored at the end
+  const bool origUseMemoryTracking=useMemoryTracking;
+  
+  useMemoryTracking=true;
+  
+  // Releases must not be deferred
+  ThreadPool::waitWorksInFlight();
+  
+  /// Manager used only for the test
+  CPUMemoryManager manager;
+  
+  /// Memory of the first site
+  char* first;
+  
+  /// Memory of the second site
+  char* second;
+  
+  {
+    /// Attributes the memory to the first site
+    MemoryLabelScope labelScope("testReportFirst");
+    
+    first=manager.provide<char>(4096);
+  }
+  
+  {
+    /// Attributes the memory to the second site
+    MemoryLabelScope labelScope("testReportSecond");
+    
+    second=manager.provide<char>(8192);
+  }
+  
+  // The peak has been reached, now the first site changes below it
+  manager.release(first);
+  
+  {
+    /// Attributes the memory to the first site
+    MemoryLabelScope labelScope("testReportFirst");
+    
+    first=manager.provide<char>(2048);
+  }
+  
+  /// Report written as a string
+  std::ostringstream report;
+  
+  manager.writeReport(report);
+  
+  for(const char* expected :
+	{"\"peakSize\": 12288",
+	 "{\"name\": \"testReportFirst\", \"nAllocs\": 2, \"totalSize\": 6144, \"nLive\": 1, \"liveSize\": 2048, \"maxLiveSize\": 4096, \"liveSizeAtPeak\": 4096}",
+	 "{\"name\": \"testReportSecond\", \"nAllocs\": 1, \"totalSize\": 8192, \"nLive\": 1, \"liveSize\": 8192, \"maxLiveSize\": 8192, \"liveSizeAtPeak\": 8192}"})
+    if(report.str().find(expected)==std::string::npos)
+      CRASHER<<"Memory report does not contain "<<expected<<", report:\n"<<report.str()<<endl;
+  
+  manager.release(first);
+  manager.release(second);
+  
+  useMemoryTracking=origUseMemoryTracking;
+}
+
+/// Write fields on file, and read them back mapping the files without copying them
+void testFileStorage(const int workReducer) ///< Reduce worksize to make a quick test
+{
+  /// Type of the field on file, a color vector on each site
+  using FileField=
+    Tens<TensComps<SpaceTime,ColRow,Compl>,double,StorLoc::ON_FILE>;
+  
+  /// Volume of the field
+  const SpaceTime vol((1<<22)/workReducer);
+  
+  /// Path of the file
+  const std::string path=
+    fileStorageDir+"/ciccio-s-test-field."+std::to_string(rank());
+  
+  unlink(path.c_str());
+  
+  {
+    FileStorageScope file(path.c_str());
+    
+    /// Field written while computed
+    FileField field(vol);
+    
+    ThreadPool::loopSplit(SpaceTime(0),vol,[&field](const SpaceTime& site)
+			  {
+			    for(ColRow c(0);c<NColComp;c++)
+			      {
+				field[site][c][RE]=site;
+				field[site][c][IM]=c;
+			      }
+			  });
+    ThreadPool::waitThatAllWorkersWaitForWork();
+    
+    fileMemoryManager->flush(field.getDataPtr());
+  }
+  
+  {
+    FileStorageScope file(path.c_str());
+    
+    /// Field read from the file
+    const FileField field(vol);
+    
+    /// Number of sites in the chunks advised to the kernel
+    std::atomic<int64_t> nAdvisedSites(0);
+    
+    /// Number of sites read with wrong values
+    std::atomic<int64_t> nWrongSites(0);
+    
+    /// Schedule of the reading loop, advising the chunks as they are taken from the shared counter
+    ThreadPool::LoopSchedule schedule=
+      loopScheduleOn<StorLoc::ON_FILE>(field.getDataPtr(),sizeof(double)*NColComp*2);
+    schedule.kind=
+      ThreadPool::ScheduleKind::DYNAMIC;
+    
+    /// Hook advising the kernel
+    const ThreadPool::LoopSchedule::ChunkHook advise=
+      schedule.onChunk;
+    
+    schedule.onEachChunk([&advise,&nAdvisedSites](const int64_t& beg,const int64_t& end)
+			 {
+			   advise(beg,end);
+			   nAdvisedSites+=end-beg;
+			 });
+    
+    /// Takes note of starting moment
+    const Instant start=takeTime();
+    
+    ThreadPool::loopSplit(SpaceTime(0),vol,[&field,&nWrongSites](const SpaceTime& site)
+			  {
+			    for(ColRow c(0);c<NColComp;c++)
+			      if(field[site][c][RE]!=(double)site or field[site][c][IM]!=(double)c)
+				nWrongSites++;
+			  },schedule);
+    ThreadPool::waitThatAllWorkersWaitForWork();
+    
+    /// Takes note of ending moment
+    const Instant end=takeTime();
+    
+    LOGGER<<"Read "<<vol*NColComp*2*sizeof(double)<<" bytes mapped from file in "<<timeDiffInSec(end,start)*1e3<<" ms"<<endl;
+    
+    if(nAdvisedSites!=vol)
+      CRASHER<<"Advised "<<nAdvisedSites<<" sites instead of "<<vol<<endl;
+    
+    if(nWrongSites)
+      CRASHER<<"Read "<<nWrongSites<<" wrong sites from "<<path<<endl;
+  }
+  
+  unlink(path.c_str());
+  
+  /// Volume of the su3 field, multiple of the SIMD length
+  const int su3Vol=
+    simdLength<double>*std::max(1,(1<<16)/workReducer);
+  
+  {
+    FileStorageScope file(path.c_str());
+    
+    /// Su3 field written on file
+    CpuSU3Field<double,StorLoc::ON_FILE> field(su3Vol);
+    
+    field.sitesLoop(KERNEL_LAMBDA_BODY(const int iSite)
+		    {
+		      for(int ic1=0;ic1<NCOL;ic1++)
+			for(int ic2=0;ic2<NCOL;ic2++)
+			  for(int ri=0;ri<2;ri++)
+			    field(iSite,ic1,ic2,ri)=ri+2*(ic2+NCOL*(ic1+NCOL*iSite));
+		    });
+    ThreadPool::waitThatAllWorkersWaitForWork();
+    
+    fileMemoryManager->flush(field.data);
+  }
+  
+  FileStorageScope file(path.c_str());
+  
+  /// Su3 field opened from file, without reading it
+  const CpuSU3Field<double,StorLoc::ON_FILE> field(su3Vol);
+  
+  /// SIMD copy of the field
+  SimdSU3Field<double,StorLoc::ON_CPU> simdField(su3Vol);
+  simdField.deepCopy(field);
+  
+  /// Field copied back from the SIMD one
+  CpuSU3Field<double,StorLoc::ON_CPU> copy(su3Vol);
+  copy.deepCopy(simdField);
+  
+  for(int iSite=0;iSite<su3Vol;iSite++)
+    for(int ic1=0;ic1<NCOL;ic1++)
+      for(int ic2=0;ic2<NCOL;ic2++)
+	for(int ri=0;ri<2;ri++)
+	  if(copy(iSite,ic1,ic2,ri)!=ri+2*(ic2+NCOL*(ic1+NCOL*iSite)))
+	    CRASHER<<"Su3 field read from "<<path<<" differs at site "<<iSite<<endl;
+  
+  unlink(path.c_str());
+}
+
+/// Check the allocations and copies of the data when returning, moving, storing and copying tensors and fields
+void testOwnership(const int workReducer) ///< Reduce worksize to make a quick test
+{
+  /// Type of the tensor, a color vector on each site
+  using T=
+    Tens<TensComps<SpaceTime,ColRow,Compl>,double,StorLoc::ON_CPU>;
+  
+  /// Type of the field, a color vector on each site
+  using F=
+    Field<SpaceTime,TensComps<ColRow,Compl>,double,StorLoc::ON_CPU,FieldLayout::CPU_LAYOUT>;
+  
+  /// Volume of the tensors
+  const SpaceTime vol((1<<16)/workReducer);
+  
+  /// Data of the latest tensor created
+  const double* created=nullptr;
+  
+  /// Creates a tensor filled with the site
+  auto makeTens=[vol,&created]()
+    {
+      /// Result
+      T t(vol);
+      
+      for(SpaceTime site(0);site<vol;site++)
+	for(ColRow c(0);c<NColComp;c++)
+	  {
+	    t[site][c][RE]=site;
+	    t[site][c][IM]=c;
+	  }
+      
+      created=t.getDataPtr();
+      
+      return t;
+    };
+  
+  /// Creates a field
+  auto makeField=[vol,&created]()
+    {
+      /// Result
+      F f(vol);
+      
+      created=f.t.getDataPtr();
+      
+      return f;
+    };
+  
+  /// Number of memory requests at the beginning of the operation
+  Size nProvides=
+    cpuMemoryManager->getNProvides();
+  
+  /// Checks the number of allocations done by the operation, and whether the data has been copied
+  auto check=[&nProvides](const char* operation,
+			  const Size& nExpectedAllocs,
+			  const bool copied,
+			  const bool expectedCopied)
+    {
+      /// Number of memory requests at the end of the operation
+      const Size n=
+	cpuMemoryManager->getNProvides();
+      
+      LOGGER<<operation<<": "<<n-nProvides<<" allocations, "<<(copied?"copied":"not copied")<<endl;
+      
+      if(n-nProvides!=nExpectedAllocs or copied!=expectedCopied)
+	CRASHER<<operation<<": expected "<<nExpectedAllocs<<" allocations, "<<(expectedCopied?"copied":"not copied")<<endl;
+      
+      nProvides=n;
+    };
+  
+  T a=
+    makeTens();
+  check("Return a tensor from a function",1,a.getDataPtr()!=created,false);
+  
+  T b(std::move(a));
+  check("Move construct a tensor",0,b.getDataPtr()!=created,false);
+  
+  /// Tensors stored in a container, growing while filled
+  std::vector<T> v;
+  
+  /// Data of the tensors when created
+  std::vector<const double*> vCreated;
+  
+  for(int i=0;i<4;i++)
+    {
+      v.push_back(makeTens());
+      vCreated.push_back(created);
+    }
+  
+  /// Determine whether the data of the tensors stored in the container have been copied
+  bool vCopied=false;
+  for(int i=0;i<4;i++)
+    vCopied|=(v[i].getDataPtr()!=vCreated[i]);
+  check("Store 4 tensors in a vector",4,vCopied,false);
+  
+  /// Data of b, to be taken by c
+  const double* bData=
+    b.getDataPtr();
+  
+  T c(vol);
+  c=std::move(b);
+  check("Move assign a newly created tensor",1,c.getDataPtr()!=bData,false);
+  
+  const auto d=
+    c.copy();
+  check("Copy a tensor",1,d.getDataPtr()!=c.getDataPtr(),true);
+  
+  {
+    /// Scope providing the copy
+    ArenaScope scope;
+    
+    /// Copy taken from the arena
+    const auto e=
+      c.copy();
+    check("Copy a tensor in an arena scope",0,e.getDataPtr()!=c.getDataPtr(),true);
+    
+    if(scope.getNProvides()!=1)
+      CRASHER<<"Copy in an arena scope not taken from the arena"<<endl;
+  }
+  
+  /// View on the data of c
+  const TensView<TensComps<SpaceTime,ColRow,Compl>,double,StorLoc::ON_CPU> view(c.getDataPtr(),c.data.getSize(),vol);
+  
+  /// Copy of the view, referring to the same data
+  const auto viewCopy=
+    view;
+  check("Copy a view",0,viewCopy.getDataPtr()!=c.getDataPtr(),false);
+  
+  F f=
+    makeField();
+  check("Return a field from a function",1,f.t.getDataPtr()!=created,false);
+  
+  const F g(f);
+  check("Copy a field",1,g.t.getDataPtr()!=f.t.getDataPtr(),true);
+  
+  for(SpaceTime site(0);site<vol;site++)
+    for(ColRow col(0);col<NColComp;col++)
+      if(d[site][col][RE]!=(double)site or d[site][col][IM]!=(double)col)
+	CRASHER<<"Copy of a tensor differs from the original at site "<<site<<endl;
+}
+
+/// Compare deep copies of a field with snapshots sharing the data by copy-on-write, checking that only the modified pages are duplicated
+void testCopyOnWrite(const int workReducer) ///< Reduce worksize to make a quick test
+{
+  /// Components of the fields, a color vector on each site
+  using Comps=
+    TensComps<ColRow,Compl>;
+  
+  /// Field taken from the memory manager
+  using F=
+    Field<SpaceTime,Comps,double,StorLoc::ON_CPU,FieldLayout::CPU_LAYOUT>;
+  
+  /// Field shared by copy-on-write
+  using CowF=
+    Field<SpaceTime,Comps,double,StorLoc::ON_CPU,FieldLayout::CPU_LAYOUT,Stackable::COPY_ON_WRITE>;
+  
+  /// Volume of the fields
+  const SpaceTime vol((1<<20)/workReducer);
+  
+  /// Number of sites modified after each copy
+  const SpaceTime nModified(vol/64);
+  
+  /// Fill the given sites of the field with the site and the value
+  auto fill=
+    [](auto& field,
+       const SpaceTime& beg,
+       const SpaceTime& end,
+       const double& val)
+    {
+      ThreadPool::loopSplit(beg,end,[&field,val](const SpaceTime& site)
+			    {
+			      for(ColRow c(0);c<NColComp;c++)
+				{
+				  field[site][c][RE]=site;
+				  field[site][c][IM]=val;
+				}
+			    });
+      ThreadPool::waitThatAllWorkersWaitForWork();
+    };
+  
+  /// Check that the field contains the site and the value on the first \c nVal sites, and the site and 0 elsewhere
+  auto check=
+    [vol](const auto& field,
+	  const SpaceTime& nVal,
+	  const double& val,
+	  const char* name)
+    {
+      for(SpaceTime site(0);site<vol;site++)
+	for(ColRow c(0);c<NColComp;c++)
+	  if(field[site][c][RE]!=(double)site or field[site][c][IM]!=((site<nVal)?val:0.0))
+	    CRASHER<<name<<": wrong value at site "<<site<<endl;
+    };
+  
+  /// Copy the field, modify part of it, check both and print the timings
+  auto run=
+    [&fill,&check,vol,nModified](auto& field,
+				 const char* name)
+    {
+      using Field=
+	std::decay_t<decltype(field)>;
+      
+      fill(field,SpaceTime(0),vol,0.0);
+      
+      /// Takes note of starting moment
+      const Instant start=takeTime();
+      
+      /// Copy of the field
+      const Field copy(field);
+      
+      /// Takes note of the end of the copy
+      const Instant copied=takeTime();
+      
+      fill(field,SpaceTime(0),nModified,1.0);
+      
+      /// Takes note of ending moment
+      const Instant end=takeTime();
+      
+      LOGGER<<name<<": copy "<<timeDiffInSec(copied,start)*1e3<<" ms, modification of "<<nModified<<" sites out of "<<vol<<" "<<timeDiffInSec(end,copied)*1e3<<" ms"<<endl;
+      
+      check(copy,SpaceTime(0),0.0,name);
+      check(field,nModified,1.0,name);
+    };
+  
+  F field(vol);
+  run(field,"Deep copy");
+  
+  /// Number of memory requests before the copy-on-write case
+  const Size nProvides=
+    cpuMemoryManager->getNProvides();
+  
+  CowF cowField(vol);
+  run(cowField,"Copy-on-write");
+  
+  if(cpuMemoryManager->getNProvides()!=nProvides)
+    CRASHER<<"Copy-on-write fields allocated from the memory manager"<<endl;
+  
+  /// Pages spanned by the modified sites
+  const Size nModifiedPagesExpected=
+    (nModified*NColComp*2*(Size)sizeof(double)+getPageSize()-1)/getPageSize();
+  
+  /// Pages duplicated by the modification
+  const Size nModifiedPages=
+    cowField.t.data.data.mapping.getNModifiedPages();
+  
+  LOGGER<<"Pages duplicated by the modification: "<<nModifiedPages<<" expected "<<nModifiedPagesExpected<<endl;
+  
+  if(nModifiedPages!=nModifiedPagesExpected)
+    CRASHER<<"Duplicated "<<nModifiedPages<<" pages instead of "<<nModifiedPagesExpected<<endl;
+  
+  /// Takes note of starting moment
+  const Instant start=takeTime();
+  
+  /// Copy of the modified field, which needs to copy only the modified pages
+  const CowF snapshot(cowField);
+  
+  /// Takes note of ending moment
+  const Instant end=takeTime();
+  
+  LOGGER<<"Copy-on-write of the modified field: "<<timeDiffInSec(end,start)*1e3<<" ms"<<endl;
+  
+  check(snapshot,nModified,1.0,"Copy-on-write of the modified field");
+}
+
+/// Compare the creation of dynamic temporaries through the memory manager and inside an arena scope, checking which are taken from the arena
+void testArenaScope(const int workReducer) ///< Reduce worksize to make a quick test
+{
+  /// Type of the temporaries, a color vector on each site
+  using Temp=
+    TensTemp<TensComps<SpaceTime,ColRow,Compl>,double,StorLoc::ON_CPU>;
+  
+  /// Number of kernels run
+  const int64_t nKernels=100000/workReducer;
+  
+  /// Volume of the temporaries
+  const SpaceTime vol(4096);
+  
+  for(const bool useArena : {false,true})
+    {
+      /// Takes note of starting moment
+      const Instant start=takeTime();
+      
+      for(int64_t iKernel=0;iKernel<nKernels;iKernel++)
+	{
+	  /// Scope of the kernel, opened only if asked
+	  std::unique_ptr<ArenaScope> scope(useArena?new ArenaScope("temporaries"):nullptr);
+	  
+	  Temp a(vol),b(vol),c(vol);
+	  a[SpaceTime(0)][ColRow(0)][RE]=b[SpaceTime(0)][ColRow(0)][RE]=c[SpaceTime(0)][ColRow(0)][RE]=iKernel;
+	}
+      
+      /// Takes note of ending moment
+      const Instant end=takeTime();
+      
+      LOGGER<<"Temporaries "<<(useArena?"in an arena scope":"from the memory manager")<<": "<<timeDiffInSec(end,start)/(3*nKernels)*1e9<<" ns per temporary"<<endl;
+    }
+  
+  {
+    /// Scope whose allocations are counted
+    ArenaScope scope;
+    
+    /// Temporary created directly
+    Temp a(vol);
+    a[SpaceTime(1)][ColRow(2)][IM]=3.0;
+    
+    /// Copy of the temporary
+    const auto b=
+      a.copy();
+    
+    /// Tensor which is not a temporary, which might outlive the scope
+    Tens<TensComps<SpaceTime,ColRow,Compl>,double,StorLoc::ON_CPU> field(vol);
+    
+    /// Type of a tensor with no dynamic component, too large for the stack
+    using Large=
+      TensTemp<TensComps<SpinRow,SpinCln,ColRow,ColCln,Compl>,long double,StorLoc::ON_CPU>;
+    
+    /// Tensor to be closed
+    Large l;
+    l[spRow(1)][spCln(2)][clRow(0)][clCln(1)][RE]=5.0;
+    
+    /// Closed expression
+    auto c=
+      l.close();
+    
+    if(scope.getNProvides()!=4)
+      CRASHER<<"Expected 4 temporaries taken from the arena, obtained "<<scope.getNProvides()<<endl;
+    
+    if(not scratchArena().contains(b.getDataPtr()) or not scratchArena().contains(c.getDataPtr()))
+      CRASHER<<"Copy or closure of a temporary not taken from the arena"<<endl;
+    
+    if(scratchArena().contains(field.getDataPtr()))
+      CRASHER<<"Tensor which is not a temporary taken from the arena"<<endl;
+    
+    if(b[SpaceTime(1)][ColRow(2)][IM]!=3.0 or c[spRow(1)][spCln(2)][clRow(0)][clCln(1)][RE]!=5.0)
+      CRASHER<<"Copy or closure of a temporary not matching the original"<<endl;
+  }
+  
+  printArenaScopeStatistics();
+}
+
+/// Measure the first sweep over memory freshly provided, provided warm, or reserved in advance
+void testPrefault(const int workReducer) ///< Reduce worksize to make a quick test
+{
+  /// Number of doubles of the memory
+  const int64_t n=(1<<26)/sizeof(double)/workReducer;
+  
+  /// Name of the cases
+  const char* caseNames[]={"fresh","warm","reserved"};
+  
+  for(int iCase=0;iCase<3;iCase++)
+    {
+      // Free the cached memory, so that the memory is allocated again
+      cpuMemoryManager->clearCache();
+      
+      if(iCase==2)
+	cpuMemoryManager->reserve(n*sizeof(double),1);
+      
+      /// Memory to be swept
+      double* data=
+	cpuMemoryManager->provide<double>(n,DEFAULT_ALIGNMENT,iCase==1);
+      
+      /// Takes note of starting moment
+      const Instant start=takeTime();
+      
+      ThreadPool::loopSplit((int64_t)0,n,[data](const int64_t& i)
+				      {
+					data[i]=i;
+				      });
+      ThreadPool::waitThatAllWorkersWaitForWork();
+      
+      /// Takes note of ending moment
+      const Instant end=takeTime();
+      
+      LOGGER<<"First sweep over "<<n*sizeof(double)<<" bytes of "<<caseNames[iCase]<<" memory: "<<timeDiffInSec(end,start)*1e3<<" ms"<<endl;
+      
+      cpuMemoryManager->release(data);
+    }
+}
+
+/// Compare the sum-product sweep on large volumes with and without huge pages
+void testHugePages(const int workReducer) ///< Reduce worksize to make a quick test
+{
+  /// Choice of the pages made through the flag, restored at the end
+  const bool origUseHugePages=useHugePages;
+  
+  for(const bool hp : {false,true})
+    {
+      useHugePages=hp;
+      
+      // Free the cached memory, so that fields are allocated again with the chosen pages
+      cpuMemoryManager->clearCache();
+      
+      LOGGER<<"Huge pages: "<<(hp?"enabled":"disabled")<<endl;
+      
+      for(int volLog2=16;volLog2<20;volLog2++)
+	test<double>(1<<volLog2,workReducer);
+      
+      if(hp)
+	cpuMemoryManager->printHugePagesReport();
+    }
+  
+  useHugePages=origUseHugePages;
+}
+
+/// Tensor holding an SU3 matrix on each site
+using SU3FieldTens=
+  Tens<SU3FieldComps,double,StorLoc::ON_CPU>;
+
+/// Compute a+=b*c on the given site, subscribing slices
+void sumProdSlices(SU3FieldTens& field1,const SU3FieldTens& field2,const SU3FieldTens& field3,const SpaceTime& iSite)
+{
+  ASM_BOOKMARK_BEGIN("SUMPROD_SLICES");
+  
+  UNROLLED_FOR(i,NCOL)
+    UNROLLED_FOR(k,NCOL)
+      UNROLLED_FOR(j,NCOL)
+      {
+	auto f1c=field1[iSite][clRow(i)][clCln(j)];
+	const auto f2c=field2[iSite][clRow(i)][clCln(k)];
+	const auto f3c=field3[iSite][clRow(k)][clCln(j)];
+	
+	/// Operands, real and imaginary part
+	const double f2r=f2c[RE],f2i=f2c[IM];
+	const double f3r=f3c[RE],f3i=f3c[IM];
+	
+	f1c[RE]+=f2r*f3r-f2i*f3i;
+	f1c[IM]+=f2r*f3i+f2i*f3r;
+      }
+      UNROLLED_FOR_END;
+    UNROLLED_FOR_END;
+  UNROLLED_FOR_END;
+  
+  ASM_BOOKMARK_END("SUMPROD_SLICES");
+}
+
+/// Compute a+=b*c on the given site, moving cursors
+///
+/// The offset of each element from the beginning of the site is a
+/// constant, so the accesses compile to loads at fixed displacement
+void sumProdCursor(SU3FieldTens& field1,const SU3FieldTens& field2,const SU3FieldTens& field3,const SpaceTime& iSite)
+{
+  ASM_BOOKMARK_BEGIN("SUMPROD_CURSOR");
+  
+  auto c1=field1[iSite].cursor();
+  const auto c2=field2[iSite].cursor();
+  const auto c3=field3[iSite].cursor();
+  
+  UNROLLED_FOR(i,NCOL)
+    UNROLLED_FOR(k,NCOL)
+      UNROLLED_FOR(j,NCOL)
+      {
+	auto f1c=c1.moved(clRow(i),clCln(j));
+	const auto f2c=c2.moved(clRow(i),clCln(k));
+	const auto f3c=c3.moved(clRow(k),clCln(j));
+	
+	f1c(RE)+=f2c(RE)*f3c(RE)-f2c(IM)*f3c(IM);
+	f1c(IM)+=f2c(RE)*f3c(IM)+f2c(IM)*f3c(RE);
+      }
+      UNROLLED_FOR_END;
+    UNROLLED_FOR_END;
+  UNROLLED_FOR_END;
+  
+  ASM_BOOKMARK_END("SUMPROD_CURSOR");
+}
+
+/// Compare the kernels accessing the tensors through slices and through cursors, and check the cursor along a dynamic component
+void testCursor(const int workReducer) ///< Reduce worksize to make a quick test
+{
+  /// Volume of the fields
+  const SpaceTime vol((1<<16)/workReducer);
+  
+  /// Number of iterations
+  const int nIters=
+    std::max(1,100/workReducer);
+  
+  SU3FieldTens field1(vol),field2(vol),field3(vol),field4(vol);
+  
+  for(SpaceTime iSite(0);iSite<vol;iSite++)
+    for(ColRow i(0);i<NColComp;i++)
+      for(ColCln j(0);j<NColComp;j++)
+	for(Compl ri(0);ri<2;ri++)
+	  {
+	    field1[iSite][i][j][ri]=field4[iSite][i][j][ri]=0.0;
+	    field2[iSite][i][j][ri]=iSite+i+ri;
+	    field3[iSite][i][j][ri]=iSite+j-ri;
+	  }
+  
+  /// Run the kernel over all sites and print the timing
+  auto run=
+    [vol,nIters](const char* name,
+		 auto kernel,
+		 SU3FieldTens& field1,
+		 const SU3FieldTens& field2,
+		 const SU3FieldTens& field3)
+    {
+      /// Takes note of starting moment
+      const Instant start=takeTime();
+      
+      for(int iIter=0;iIter<nIters;iIter++)
+	{
+	  ThreadPool::loopSplit(SpaceTime(0),vol,[&](const SpaceTime& iSite)
+						 {
+						   kernel(field1,field2,field3,iSite);
+						 });
+	  ThreadPool::waitThatAllWorkersWaitForWork();
+	}
+      
+      /// Takes note of ending moment
+      const Instant end=takeTime();
+      
+      LOGGER<<name<<": "<<timeDiffInSec(end,start)/(nIters*(double)vol)*1e9<<" ns per site"<<endl;
+    };
+  
+  run("Slices",sumProdSlices,field1,field2,field3);
+  run("Cursor",sumProdCursor,field4,field2,field3);
+  
+  /// Maximal difference between the results
+  double maxDiff=0;
+  
+  for(SpaceTime iSite(0);iSite<vol;iSite++)
+    for(ColRow i(0);i<NColComp;i++)
+      for(ColCln j(0);j<NColComp;j++)
+	for(Compl ri(0);ri<2;ri++)
+	  maxDiff=std::max(maxDiff,std::abs(field1[iSite][i][j][ri]-field4[iSite][i][j][ri]));
+  
+  LOGGER<<"Maximal difference between slices and cursor: "<<maxDiff<<endl;
+  
+  if(maxDiff!=0)
+    CRASHER<<"Kernel through cursors differs from the one through slices by "<<maxDiff<<endl;
+  
+  /// Tensor with the dynamic component in the middle, whose stride is taken from the table
+  Tens<TensComps<ColRow,SpaceTime,Compl>,double,StorLoc::ON_CPU> t(vol);
+  
+  for(ColRow i(0);i<NColComp;i++)
+    for(SpaceTime iSite(0);iSite<vol;iSite++)
+      for(Compl ri(0);ri<2;ri++)
+	t[i][iSite][ri]=(iSite*NCOL+i)*2+ri;
+  
+  /// Number of elements found in the wrong place
+  int nWrong=0;
+  
+  for(ColRow i(0);i<NColComp;i++)
+    {
+      /// Cursor running along the sites
+      auto c=
+	t[i].cursor();
+      
+      for(SpaceTime iSite(0);iSite<vol;iSite++,c.advance(SpaceTime(1)))
+	for(Compl ri(0);ri<2;ri++)
+	  nWrong+=(c(ri)!=(iSite*NCOL+i)*2+ri);
+    }
+  
+  if(nWrong)
+    CRASHER<<"Cursor reached "<<nWrong<<" elements in the wrong place"<<endl;
+}
+
 /// inMmain is the actual main, which is where the main thread of the
 /// pool is sent to work while the workers are sent in the background
 void inMain(int narg,char **arg)
@@ -626,6 +1929,44 @@ void inMain(int narg,char **arg)
       LOGGER<<"WorkReducer: "<<workReducer<<endl;
     }
   
+  LOGGER<<"/////////////////////////////////////////////////////////////////"<<endl;
+  LOGGER<<"                      launch overhead"<<endl;
+  LOGGER<<"/////////////////////////////////////////////////////////////////"<<endl;
+  
+  testLoopSplitLayout();
+  testScratchArena();
+  
+  for(int volLog2=4;volLog2<=8;volLog2++)
+    testLaunchOverhead(1<<volLog2,workReducer);
+  
+  LOGGER<<"/////////////////////////////////////////////////////////////////"<<endl;
+  LOGGER<<"                      barrier latency"<<endl;
+  LOGGER<<"/////////////////////////////////////////////////////////////////"<<endl;
+  
+  testBarrierLatency(workReducer);
+  
+  LOGGER<<"/////////////////////////////////////////////////////////////////"<<endl;
+  LOGGER<<"                      backends"<<endl;
+  LOGGER<<"/////////////////////////////////////////////////////////////////"<<endl;
+  
+  testBackends(workReducer);
+  
+  LOGGER<<"/////////////////////////////////////////////////////////////////"<<endl;
+  LOGGER<<"                      memory manager"<<endl;
+  LOGGER<<"/////////////////////////////////////////////////////////////////"<<endl;
+  
+  testMemoryManager(workReducer);
+  testPrefault(workReducer);
+  testArenaScope(workReducer);
+  testFileStorage(workReducer);
+  testOwnership(workReducer);
+  testCopyOnWrite(workReducer);
+  testCursor(workReducer);
+  
+  testMemoryCacheBudget();
+  
+  testMemoryReport();
+  
   // Loop ofer float and double
   forEachInTuple(std::tuple<float,double>{},
 		 [&](auto t)
@@ -645,6 +1986,12 @@ void inMain(int narg,char **arg)
 		     }
 		 });
   
+  LOGGER<<"/////////////////////////////////////////////////////////////////"<<endl;
+  LOGGER<<"                      huge pages"<<endl;
+  LOGGER<<"/////////////////////////////////////////////////////////////////"<<endl;
+  
+  testHugePages(workReducer);
+  
 }
 
 /// This might be moved to the library, and \a inMain expected
@@ -5,14 +5,18 @@
 ///
 /// \brief Include all headers from base directory
 
+#include <base/copyOnWrite.hpp>
 #include <base/debug.hpp>
 #include <base/environment.hpp>
 #include <base/feature.hpp>
+#include <base/fileMemoryManager.hpp>
 #include <base/inliner.hpp>
 #include <base/logger.hpp>
 #include <base/memoryManager.hpp>
+#include <base/memoryReport.hpp>
 #include <base/metaProgramming.hpp>
 #include <base/ranks.hpp>
+#include <base/scratchArena.hpp>
 #include <base/timings.hpp>
 #include <base/unroll.hpp>
 
@@ -12,6 +12,7 @@
 #include <tensors/component.hpp>
 #include <tensors/complSubscribe.hpp>
 #include <tensors/tens.hpp>
+#include <tensors/tensCursor.hpp>
 #include <tensors/tensDecl.hpp>
 #include <tensors/tensRef.hpp>
 #include <tensors/tensSlice.hpp>
@@ -9,6 +9,10 @@
 # include "config.hpp"
 #endif
 
+#include <threads/barrier.hpp>
 #include <threads/pool.hpp>
+#include <threads/reduce.hpp>
+#include <threads/team.hpp>
+#include <threads/workStealing.hpp>
 
 #endif
@@ -0,0 +1,217 @@
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+/// \file copyOnWrite.cpp
+///
+/// \brief Implements the memory shared by copy-on-write
+
+#include "base/copyOnWrite.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <threads/pool.hpp>
+
+namespace ciccios
+{
+  /// Maps the file at the given address, or anywhere if null
+  static void* mapFile(void* addr,
+		       const Size& size,
+		       const int& fd,
+		       const bool& isPrivate)
+  {
+    /// Result
+    void* ptr=
+      mmap(addr,size,PROT_READ|PROT_WRITE,(isPrivate?MAP_PRIVATE:MAP_SHARED)|(addr?MAP_FIXED:0),fd,0);
+    
+    if(ptr==MAP_FAILED)
+      CRASHER<<"Unable to map "<<size<<" bytes of memory shared by copy-on-write: "<<strerror(errno)<<endl;
+    
+    return
+      ptr;
+  }
+  
+  CopyOnWriteMapping::CopyOnWriteMapping(const Size& askedSize) :
+    isPrivate(false)
+  {
+    size=
+      std::max((askedSize+getPageSize()-1)/getPageSize(),(Size)1)*getPageSize();
+    
+    /// Descriptor of the file
+    const int fd=
+      memfd_create("ciccio-s-cow",MFD_CLOEXEC);
+    
+    if(fd<0)
+      {
+	if(errno==EMFILE or errno==ENFILE)
+	  CRASHER<<"Unable to create the memory file for copy-on-write: the limit on open files has been reached, "
+	    "each live mapping and its copies keep one open, raise the limit (ulimit -n) or release some mappings"<<endl;
+	
+	CRASHER<<"Unable to create the memory file for copy-on-write: "<<strerror(errno)<<endl;
+      }
+    
+    if(ftruncate(fd,size))
+      CRASHER<<"Unable to resize the memory file for copy-on-write to "<<size<<": "<<strerror(errno)<<endl;
+    
+    file=
+      new SharedFile(fd);
+    
+    ptr=
+      mapFile(nullptr,size,fd,false);
+  }
+  
+  CopyOnWriteMapping::CopyOnWriteMapping(const CopyOnWriteMapping& oth) :
+    file(oth.file),
+    size(oth.size),
+    isPrivate(true)
+  {
+    ThreadPool::waitWorksInFlight();
+    
+    // The data of oth is all in the file, which is never written again
+    if(not oth.isPrivate)
+      {
+	mapFile(oth.ptr,size,file->fd,true);
+	oth.isPrivate=true;
+      }
+    
+    file->nOwners++;
+    
+    ptr=
+      mapFile(nullptr,size,file->fd,true);
+    
+    /// Pages of oth differing from the file
+    const std::vector<bool> modified=
+      oth.getModifiedPages();
+    
+    /// List of the pages to be copied
+    std::vector<Size> toCopy;
+    for(Size iPage=0;iPage<(Size)modified.size();iPage++)
+      if(modified[iPage])
+	toCopy.push_back(iPage);
+    
+    /// Beginning of the destination
+    char* dst=
+      static_cast<char*>(ptr);
+    
+    /// Beginning of the source
+    const char* src=
+      static_cast<const char*>(oth.ptr);
+    
+    /// Copy the given page
+    auto copyPage=
+      [dst,src,&toCopy](const Size& i)
+      {
+	/// Offset of the page
+	const Size offset=
+	  toCopy[i]*getPageSize();
+	
+	memcpy(dst+offset,src+offset,getPageSize());
+      };
+    
+    if(ThreadPool::canDispatchWork() and toCopy.size()>=(size_t)ThreadPool::getCurrentNThreads())
+      {
+	ThreadPool::loopSplit((Size)0,(Size)toCopy.size(),copyPage);
+	ThreadPool::waitThatAllWorkersWaitForWork();
+      }
+    else
+      for(Size i=0;i<(Size)toCopy.size();i++)
+	copyPage(i);
+    
+    VERB_LOGGER(1)<<"Shared "<<size<<" bytes by copy-on-write, copied "<<toCopy.size()<<" modified pages"<<endl;
+  }
+  
+  CopyOnWriteMapping::~CopyOnWriteMapping()
+  {
+    if(file==nullptr)
+      return;
+    
+    ThreadPool::waitWorksInFlight();
+    
+    if(munmap(ptr,size))
+      CRASHER<<"Unable to unmap "<<ptr<<": "<<strerror(errno)<<endl;
+    
+    if(file->nOwners.fetch_sub(1)==1)
+      {
+	close(file->fd);
+	delete file;
+      }
+  }
+  
+  std::vector<bool> CopyOnWriteMapping::getModifiedPages()
+    const
+  {
+    /// Number of pages
+    const Size nPages=
+      size/getPageSize();
+    
+    // A shared mapping writes into the file, so no page differs from it
+    if(not isPrivate)
+      return std::vector<bool>(nPages,false);
+    
+    /// Result, all pages marked until the information is read
+    std::vector<bool> modified(nPages,true);
+    
+    /// Descriptor of the table of the pages of the process
+    const int fd=
+      open("/proc/self/pagemap",O_RDONLY);
+    
+    if(fd<0)
+      return modified;
+    
+    /// Entries of the table, one per page
+    std::vector<uint64_t> entries(nPages);
+    
+    /// Size of the entries
+    const Size entriesSize=
+      sizeof(uint64_t)*nPages;
+    
+    /// Position of the first entry
+    const off_t offset=
+      reinterpret_cast<uintptr_t>(ptr)/getPageSize()*sizeof(uint64_t);
+    
+    if(pread(fd,entries.data(),entriesSize,offset)==(ssize_t)entriesSize)
+      for(Size iPage=0;iPage<nPages;iPage++)
+	{
+	  /// Entry of the page
+	  const uint64_t& e=
+	    entries[iPage];
+	  
+	  /// The page is in memory
+	  const bool present=
+	    (e>>63)&1;
+	  
+	  /// The page is swapped out, which only happens to pages not belonging to the file
+	  const bool swapped=
+	    (e>>62)&1;
+	  
+	  /// The page belongs to the file
+	  const bool inFile=
+	    (e>>61)&1;
+	  
+	  modified[iPage]=
+	    swapped or (present and not inFile);
+	}
+    
+    close(fd);
+    
+    return
+      modified;
+  }
+  
+  Size CopyOnWriteMapping::getNModifiedPages()
+    const
+  {
+    /// Pages differing from the file
+    const std::vector<bool> modified=
+      getModifiedPages();
+    
+    return
+      std::count(modified.begin(),modified.end(),true);
+  }
+}
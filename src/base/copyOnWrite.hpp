@@ -0,0 +1,138 @@
+#ifndef _COPY_ON_WRITE_HPP
+#define _COPY_ON_WRITE_HPP
+
+/// \file copyOnWrite.hpp
+///
+/// \brief Memory shared among copies, duplicated page by page when written
+///
+/// The memory is backed by an anonymous file in memory. As long as
+/// a single owner exists, it maps the file shared and writes into it
+/// directly. When a copy is made, all owners map the file privately,
+/// and the file is never written again: the kernel duplicates a page
+/// of an owner only when the owner first writes it, in the thread
+/// writing it. Modifying part of a copy thus duplicates only the
+/// modified pages, and a kernel writing the whole data in parallel
+/// duplicates the pages in parallel. When copying an owner which has
+/// already modified some of its pages, only these are copied to the
+/// new owner, in parallel among the threads of the pool.
+///
+/// The file is kept open as long as any of its owners lives, since
+/// copying an owner needs to map it again. Each mapping created
+/// from scratch, together with all its copies, thus takes a file
+/// descriptor, and at most as many of them as allowed by the limit
+/// on open files of the process (\c ulimit \c -n, typically 1024)
+/// can be alive at the same time. Creating one more crashes with an
+/// explicit message.
+
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+#include <atomic>
+#include <vector>
+
+#include <base/debug.hpp>
+#include <base/memoryManager.hpp>
+
+namespace ciccios
+{
+  /// Owner of memory shared by copy-on-write with its copies
+  ///
+  /// Can be created, copied and destroyed by any thread, but not
+  /// copied while a work of the pool is modifying it.
+  class CopyOnWriteMapping
+  {
+    /// Anonymous file backing the memory, shared among all copies
+    struct SharedFile
+    {
+      /// Descriptor of the file
+      const int fd;
+      
+      /// Number of owners mapping the file
+      std::atomic<int> nOwners;
+      
+      /// Create with a single owner
+      SharedFile(const int fd) :
+	fd(fd),
+	nOwners(1)
+      {
+      }
+    };
+    
+    /// File mapped, null if the mapping has been moved away
+    SharedFile* file;
+    
+    /// Beginning of the mapping
+    void* ptr;
+    
+    /// Size of the mapping, rounded to entire pages
+    Size size;
+    
+    /// Determine whether the file is mapped privately, changed when copying
+    mutable bool isPrivate;
+    
+    /// Mark the pages modified since the file has been mapped privately
+    ///
+    /// If the kernel does not provide the information, all pages are
+    /// marked
+    std::vector<bool> getModifiedPages()
+      const;
+    
+  public:
+    
+    /// Maps a new file of the given size
+    ///
+    /// Takes a file descriptor until the last copy is destroyed
+    CopyOnWriteMapping(const Size& size);
+    
+    /// Creates a copy, sharing the file
+    ///
+    /// The pages modified by \c oth since the file has been shared
+    /// are copied in parallel
+    CopyOnWriteMapping(const CopyOnWriteMapping& oth);
+    
+    /// Move constructor, taking the mapping of \c oth
+    CopyOnWriteMapping(CopyOnWriteMapping&& oth) noexcept :
+      file(oth.file),
+      ptr(oth.ptr),
+      size(oth.size),
+      isPrivate(oth.isPrivate)
+    {
+      oth.file=nullptr;
+      oth.ptr=nullptr;
+      oth.size=0;
+    }
+    
+    /// Move assignment, exchanging the mapping with \c oth, which unmaps it
+    CopyOnWriteMapping& operator=(CopyOnWriteMapping&& oth) noexcept
+    {
+      std::swap(file,oth.file);
+      std::swap(ptr,oth.ptr);
+      std::swap(size,oth.size);
+      std::swap(isPrivate,oth.isPrivate);
+      
+      return
+	*this;
+    }
+    
+    /// Forbids copy assignment, which would need to unmap the destination
+    CopyOnWriteMapping& operator=(const CopyOnWriteMapping&)=delete;
+    
+    /// Unmaps the file, closing it if no other owner is left
+    ~CopyOnWriteMapping();
+    
+    /// Returns the beginning of the memory
+    void* getPtr()
+      const
+    {
+      return
+	ptr;
+    }
+    
+    /// Number of pages duplicated for this owner since the file has been shared
+    Size getNModifiedPages()
+      const;
+  };
+}
+
+#endif
@@ -24,6 +24,9 @@
 #include <tuple>
 
 #include <base/debug.hpp>
+#include <base/fileMemoryManager.hpp>
+#include <base/memoryManager.hpp>
+#include <base/scratchArena.hpp>
 #include <threads/pool.hpp>
 
 namespace ciccios
@@ -34,8 +37,27 @@ namespace ciccios
   
   /// List of known flags
   FLAG_LIST(std::make_tuple(std::make_tuple(&waitToAttachDebuggerFlag,false,"WAIT_TO_ATTACH_DEBUGGER","to be used to wait for gdb to attach")
+			    ,std::make_tuple(&scratchArenaSize,(int64_t)(1<<24),"SCRATCH_ARENA_SIZE","size in bytes of the scratch arena of each thread")
+			    ,std::make_tuple(&useHugePages,false,"HUGE_PAGES","to be used to back large CPU allocations with huge pages")
+			    ,std::make_tuple(&hugePagesThreshold,HUGE_PAGE_SIZE,"HUGE_PAGES_THRESHOLD","minimal size in bytes of the CPU allocations backed by huge pages")
+			    ,std::make_tuple(&memoryCacheBudget,(Size)0,"MEMORY_CACHE_BUDGET","maximal size in bytes of the memory cache shared among threads, unbounded if zero")
+			    ,std::make_tuple(&memoryCacheMaxWaste,0.25,"MEMORY_CACHE_MAX_WASTE","maximal fraction of a cached memory wasted when reused for a smaller allocation")
+			    ,std::make_tuple(&useMemoryTracking,false,"MEMORY_TRACKING","to be used to take note of the site of each allocation")
+			    ,std::make_tuple(&memoryReportFile,std::string(""),"MEMORY_REPORT_FILE","file where to write the memory report at the end, suffixed with the kind of memory and the rank")
+			    ,std::make_tuple(&fileStorageDir,std::string("/tmp"),"FILE_STORAGE_DIR","directory where to create the temporary files backing the data stored on file")
+			    ,std::make_tuple(&fileStorageReadAhead,(Size)(1<<23),"FILE_STORAGE_READ_AHEAD","size in bytes of the data on file read in advance at the beginning of each chunk of a loop")
 #ifdef USE_THREADS
 			    ,std::make_tuple(&useDetachedPool,false,"USE_DETACHED_POOL","to be used to create a pool at the begin")
+			    ,std::make_tuple(&ThreadPool::backendName,std::string("spin"),"POOL_BACKEND","backend used to run the works: spin, openmp or condvar")
+			    ,std::make_tuple(&ThreadPool::nWaitSpinIterations,10000,"POOL_SPIN_ITERATIONS","number of iterations spinning before yielding, when waiting for work")
+			    ,std::make_tuple(&ThreadPool::nWaitYieldIterations,100,"POOL_YIELD_ITERATIONS","number of iterations yielding before parking, when waiting for work")
+			    ,std::make_tuple(&ThreadPool::useWaitStatistics,false,"POOL_WAIT_STATISTICS","to be used to collect and print the statistics on the waiting of the workers")
+			    ,std::make_tuple(&ThreadPool::useAdaptiveLoopSplit,true,"ADAPTIVE_LOOP_SPLIT","to be used to let the loops asking for it run serially when small, or on a subset of threads with OpenMP")
+			    ,std::make_tuple(&ThreadPool::threadAffinity,std::string("none"),"THREAD_AFFINITY","pinning of threads: none, compact, scatter, or comma separated list of cores")
+			    ,std::make_tuple(&ThreadPool::useWorkProfiling,false,"WORK_PROFILE","to be used to record the time spent by each thread in the works of the pool")
+			    ,std::make_tuple(&ThreadPool::nMaxProfiledWorks,100000,"WORK_PROFILE_MAX_WORKS","maximal number of works recorded by each thread")
+			    ,std::make_tuple(&ThreadPool::workProfileFile,std::string(""),"WORK_PROFILE_FILE","file where to export the records of the works, suffixed with the rank")
+			    ,std::make_tuple(&useParallelFirstTouch,false,"NUMA_FIRST_TOUCH","to be used to touch in parallel the newly allocated memory")
 #endif
 			    ));
   
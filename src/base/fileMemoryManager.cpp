@@ -0,0 +1,213 @@
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+/// \file fileMemoryManager.cpp
+///
+/// \brief Implements the mapping of files in memory
+
+#define EXTERN_FILE_MEMORY_MANAGER
+# include "base/fileMemoryManager.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <threads/pool.hpp>
+
+namespace ciccios
+{
+  FileMemoryManager::FileMemoryManager() :
+    mappedSize(0),
+    nMappings(0)
+  {
+    LOGGER<<"Starting the file memory manager"<<endl;
+  }
+  
+  FileMemoryManager::~FileMemoryManager()
+  {
+    LOGGER<<"Stopping the file memory manager"<<endl;
+    
+    printStatistics();
+    
+    // Any work using the memory must have been completed
+    ThreadPool::waitThatAllWorkersWaitForWork();
+    
+    for(auto& el : mappings)
+      {
+	VERB_LOGGER(3)<<"Unmapping "<<el.first<<" size "<<el.second.size<<endl;
+	munmap(el.first,el.second.size);
+      }
+  }
+  
+  void* FileMemoryManager::provideRaw(const Size size,
+				      const Size alignment)
+  {
+    if(alignment>getPageSize())
+      CRASHER<<"Unable to map files with alignment "<<alignment<<" larger than a page"<<endl;
+    
+    /// Path of the file asked by the thread, if any
+    const char* askedPath=
+      resources::fileStoragePath;
+    
+    /// Path of the file
+    std::string path;
+    
+    /// Descriptor of the file
+    int fd;
+    
+    if(askedPath)
+      {
+	// The file is used only for this allocation
+	resources::fileStoragePath=
+	  nullptr;
+	
+	path=
+	  askedPath;
+	
+	fd=
+	  open(askedPath,O_RDWR|O_CREAT,0644);
+	
+	if(fd<0)
+	  CRASHER<<"Unable to open "<<path<<": "<<strerror(errno)<<endl;
+	
+	/// Status of the file, to get its size
+	struct stat st;
+	
+	if(fstat(fd,&st))
+	  CRASHER<<"Unable to get the size of "<<path<<": "<<strerror(errno)<<endl;
+	
+	if(st.st_size!=0 and st.st_size!=size)
+	  CRASHER<<"File "<<path<<" has size "<<st.st_size<<" while "<<size<<" is needed"<<endl;
+	
+	if(st.st_size==0 and ftruncate(fd,size))
+	  CRASHER<<"Unable to resize "<<path<<" to "<<size<<": "<<strerror(errno)<<endl;
+      }
+    else
+      {
+	/// Template of the name of the temporary file
+	std::string name=
+	  fileStorageDir+"/ciccio-s-XXXXXX";
+	
+	fd=
+	  mkstemp(&name[0]);
+	
+	if(fd<0)
+	  CRASHER<<"Unable to create a temporary file in "<<fileStorageDir<<": "<<strerror(errno)<<endl;
+	
+	// The file is removed when unmapped
+	unlink(name.c_str());
+	
+	if(ftruncate(fd,size))
+	  CRASHER<<"Unable to resize the temporary file "<<name<<" to "<<size<<": "<<strerror(errno)<<endl;
+      }
+    
+    /// Result
+    void* ptr=
+      mmap(nullptr,size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+    
+    // The mapping keeps the file open
+    close(fd);
+    
+    if(ptr==MAP_FAILED)
+      CRASHER<<"Unable to map "<<size<<" bytes of "<<(path==""?"a temporary file":path)<<": "<<strerror(errno)<<endl;
+    
+    VERB_LOGGER(1)<<"Mapped "<<size<<" bytes of "<<(path==""?"a temporary file":path)<<" at "<<ptr<<endl;
+    
+    /// Lock on the list of mappings
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    mappings[ptr]={size,path};
+    mappedSize+=size;
+    nMappings++;
+    
+    return
+      ptr;
+  }
+  
+  void FileMemoryManager::releaseRaw(void* ptr)
+  {
+    ThreadPool::waitWorksInFlight();
+    
+    /// Lock on the list of mappings
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    /// Iterator to search result
+    auto el=
+      mappings.find(ptr);
+    
+    if(el==mappings.end())
+      CRASHER<<"Unable to find the mapped memory "<<ptr<<endl;
+    
+    VERB_LOGGER(3)<<"Unmapping "<<ptr<<" size "<<el->second.size<<endl;
+    
+    if(munmap(ptr,el->second.size))
+      CRASHER<<"Unable to unmap "<<ptr<<": "<<strerror(errno)<<endl;
+    
+    mappedSize-=el->second.size;
+    
+    mappings.erase(el);
+  }
+  
+  void FileMemoryManager::flush(const void* ptr)
+  {
+    /// Lock on the list of mappings
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    /// Iterator to search result
+    auto el=
+      mappings.find(const_cast<void*>(ptr));
+    
+    if(el==mappings.end())
+      CRASHER<<"Unable to find the mapped memory "<<ptr<<endl;
+    
+    if(msync(const_cast<void*>(ptr),el->second.size,MS_SYNC))
+      CRASHER<<"Unable to write back "<<ptr<<": "<<strerror(errno)<<endl;
+  }
+  
+  ThreadPool::LoopSchedule::ChunkHook FileMemoryManager::loopSplitAdvice(const void* ptr,
+									 const Size& bytesPerIteration)
+    const
+  {
+    return
+      [ptr,bytesPerIteration](const int64_t& beg,
+			      const int64_t& end)
+      {
+	/// Size of a page
+	const Size pageSize=
+	  getPageSize();
+	
+	/// Beginning of the chunk
+	const uintptr_t chunkBeg=
+	  reinterpret_cast<uintptr_t>(ptr)+beg*bytesPerIteration;
+	
+	/// Beginning of the first page of the chunk
+	const uintptr_t pageBeg=
+	  chunkBeg-chunkBeg%pageSize;
+	
+	/// Size of the chunk
+	const Size chunkSize=
+	  (end-beg)*bytesPerIteration;
+	
+	if(chunkSize>0)
+	  {
+	    madvise(reinterpret_cast<void*>(pageBeg),chunkBeg+chunkSize-pageBeg,MADV_SEQUENTIAL);
+	    madvise(reinterpret_cast<void*>(pageBeg),chunkBeg+std::min(chunkSize,fileStorageReadAhead)-pageBeg,MADV_WILLNEED);
+	  }
+      };
+  }
+  
+  void FileMemoryManager::printStatistics()
+  {
+    /// Lock on the list of mappings
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    LOGGER<<
+      "Maximal memory mapped from files: "<<mappedSize.extreme()<<" bytes, "
+      "currently mapped: "<<(Size)mappedSize<<" bytes in "<<mappings.size()<<" files, "
+      "number of files mapped: "<<nMappings<<endl;
+  }
+}
@@ -0,0 +1,196 @@
+#ifndef _FILE_MEMORY_MANAGER_HPP
+#define _FILE_MEMORY_MANAGER_HPP
+
+/// \file fileMemoryManager.hpp
+///
+/// \brief Manager of memory mapped from files
+///
+/// Data stored on file is mapped in memory, so that it can be
+/// accessed as any CPU data, while the kernel moves the pages between
+/// memory and disk as needed. This allows to handle data larger than
+/// the memory of the node. By default each allocation is backed by a
+/// temporary file, removed as soon as it is mapped. If a
+/// \c FileStorageScope is open in the thread, the next allocation is
+/// instead backed by the given file, created if not existing, so that
+/// saved data can be opened without copying it, and new data is
+/// saved while computed.
+
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <base/debug.hpp>
+#include <base/memoryManager.hpp>
+#include <threads/loopSchedule.hpp>
+
+#ifndef EXTERN_FILE_MEMORY_MANAGER
+# define EXTERN_FILE_MEMORY_MANAGER extern
+#endif
+
+namespace ciccios
+{
+  /// Directory where to create the temporary files
+  EXTERN_FILE_MEMORY_MANAGER std::string fileStorageDir;
+  
+  /// Amount of data to be read in advance at the beginning of each chunk of a loop assigned to a thread
+  EXTERN_FILE_MEMORY_MANAGER Size fileStorageReadAhead;
+  
+  namespace resources
+  {
+    /// Path of the file backing the next allocation on file of the thread, null if none
+    EXTERN_FILE_MEMORY_MANAGER thread_local const char* fileStoragePath;
+  }
+  
+  /// Backs with the given file the next allocation on file made by the thread during the lifetime of the scope
+  ///
+  /// If the file exists, its size must match the size of the
+  /// allocation, otherwise it is created.
+  class FileStorageScope
+  {
+    /// Path set by the enclosing scope
+    const char* const prevPath;
+    
+  public:
+    
+    /// Opens the scope, the path must live as long as the scope
+    FileStorageScope(const char* path) :
+      prevPath(resources::fileStoragePath)
+    {
+      resources::fileStoragePath=path;
+    }
+    
+    /// Closes the scope, restoring the path of the enclosing one
+    ~FileStorageScope()
+    {
+      resources::fileStoragePath=prevPath;
+    }
+    
+    /// Forbids copying the scope
+    FileStorageScope(const FileStorageScope&)=delete;
+  };
+  
+  /// Manager of memory mapped from files
+  ///
+  /// Memory is not cached, every allocation maps a file and every
+  /// release unmaps it. Can be called by any thread.
+  class FileMemoryManager
+  {
+    /// File mapped in memory
+    struct Mapping
+    {
+      /// Size of the mapping
+      Size size;
+      
+      /// Path of the file, empty if temporary
+      std::string path;
+    };
+    
+    /// Protects the list of mappings and the statistics
+    std::mutex mutex;
+    
+    /// Files mapped, indexed by pointer
+    std::unordered_map<void*,Mapping> mappings;
+    
+    /// Size of memory mapped
+    ValWithMax<Size> mappedSize;
+    
+    /// Number of files mapped so far
+    Size nMappings;
+    
+    /// Maps a file of the given size, the one asked through \c FileStorageScope or a temporary one
+    void* provideRaw(const Size size,
+		     const Size alignment);
+    
+    /// Unmaps a file, writing back the modified data
+    void releaseRaw(void* ptr);
+    
+  public:
+    
+    /// Provides memory mapped from a file
+    template <class T>
+    T* provide(const Size nel,
+	       const Size alignment=DEFAULT_ALIGNMENT)
+    {
+      return
+	static_cast<T*>(provideRaw(sizeof(T)*nel,alignment));
+    }
+    
+    /// Unmaps the file
+    ///
+    /// If works dispatched to the pool might still be using the
+    /// memory, waits for their completion.
+    template <typename T>
+    void release(T* &ptr) ///< Pointer getting freed
+    {
+      releaseRaw(static_cast<void*>(ptr));
+      
+      ptr=
+	nullptr;
+    }
+    
+    /// Writes the modified data back to the file, waiting for completion
+    void flush(const void* ptr);
+    
+    /// Hook advising the kernel about the memory read by each chunk of a loop split among threads
+    ///
+    /// Iteration \c i of the loop accesses the bytes starting at
+    /// <tt>i*bytesPerIteration</tt> from \a ptr. To be set as chunk
+    /// hook of the schedule passed to \c loopSplit: the memory of
+    /// each chunk is advised to be accessed sequentially, and its
+    /// beginning is read in advance, whatever the schedule.
+    ThreadPool::LoopSchedule::ChunkHook loopSplitAdvice(const void* ptr,                ///< Beginning of the memory
+							const Size& bytesPerIteration)  ///< Memory accessed by each iteration
+      const;
+    
+    /// Print the statistics
+    void printStatistics();
+    
+    /// Create the manager
+    FileMemoryManager();
+    
+    /// Unmaps all files still mapped
+    ~FileMemoryManager();
+  };
+  
+  /// Memory manager for data on file
+  EXTERN_FILE_MEMORY_MANAGER FileMemoryManager* fileMemoryManager;
+  
+  /// Use memory manager
+  ///
+  /// File case
+  template <>
+  struct MemoryManageWrapper<StorLoc::ON_FILE>
+  {
+    /// Returns the file memory manager
+    static auto& get()
+    {
+      return fileMemoryManager;
+    }
+  };
+  
+  /// Schedule of a loop split among threads, whose iteration \c i reads <tt>i*bytesPerIteration</tt> bytes after \a ptr
+  ///
+  /// Data on file is advised to the kernel chunk by chunk, the
+  /// default schedule is returned for other storages.
+  template <StorLoc SL>
+  ThreadPool::LoopSchedule loopScheduleOn(const void* ptr,                ///< Beginning of the memory
+					  const Size& bytesPerIteration)  ///< Memory accessed by each iteration
+  {
+    /// Result
+    ThreadPool::LoopSchedule schedule;
+    
+    if(SL==StorLoc::ON_FILE)
+      schedule.onEachChunk(fileMemoryManager->loopSplitAdvice(ptr,bytesPerIteration));
+    
+    return
+      schedule;
+  }
+}
+
+#undef EXTERN_FILE_MEMORY_MANAGER
+
+#endif
@@ -29,7 +29,10 @@ namespace ciccios
     EXTERN_LOGGER std::ofstream errLogger INIT_LOGGER_TO("/dev/stdout");
     
     /// Wired out logger
-    EXTERN_LOGGER std::ofstream dummyLogger INIT_LOGGER_TO("/dev/null");
+    ///
+    /// Never opened, so that the output is discarded without any
+    /// system call
+    EXTERN_LOGGER std::ofstream dummyLogger;
     
     /// Level of verbosity to be used for logging
     EXTERN_LOGGER int verbosityLv INIT_LOGGER_TO(1);
@@ -66,7 +69,10 @@ namespace ciccios
 #define LOGGER logger()
   
   /// Verbose logger or not, capital worded for homogeneity
-#define VERB_LOGGER(LV) verbLogger(LV)
+  ///
+  /// The output is not even formatted if the level is not reached,
+  /// as in hot paths such as the memory manager
+#define VERB_LOGGER(LV) if((LV)>ciccios::resources::verbosityLv) {} else verbLogger(LV)
   
   /// Prints the banner
   void printBanner();
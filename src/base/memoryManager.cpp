@@ -7,6 +7,158 @@
 #define EXTERN_MEMORY_MANAGER
 # include "memoryManager.hpp"
 
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
 namespace ciccios
 {
+  void* CPUMemoryManager::allocateHugePages(const Size size)
+  {
+    /// Size of the mapping, multiple of the huge page size
+    const Size mappedSize=
+      (size+HUGE_PAGE_SIZE-1)/HUGE_PAGE_SIZE*HUGE_PAGE_SIZE;
+    
+    /// Kind of pages obtained
+    PagesKind kind=
+      PagesKind::EXPLICIT_HUGE;
+    
+    /// Result
+    void* ptr=
+      mmap(nullptr,mappedSize,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+    
+    if(ptr==MAP_FAILED)
+      {
+	VERB_LOGGER(2)<<"Unable to map "<<mappedSize<<" bytes with explicit huge pages: "<<strerror(errno)<<endl;
+	
+	kind=
+	  PagesKind::TRANSPARENT_HUGE;
+	
+	/// Mapping larger by a huge page, to be trimmed to an aligned region
+	char* base=
+	  static_cast<char*>(mmap(nullptr,mappedSize+HUGE_PAGE_SIZE,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0));
+	
+	if(base==MAP_FAILED)
+	  {
+	    VERB_LOGGER(1)<<"Unable to map "<<mappedSize<<" bytes, falling back to small pages: "<<strerror(errno)<<endl;
+	    
+	    return nullptr;
+	  }
+	
+	/// Beginning of the aligned region
+	char* beg=
+	  base+(HUGE_PAGE_SIZE-reinterpret_cast<uintptr_t>(base)%HUGE_PAGE_SIZE)%HUGE_PAGE_SIZE;
+	
+	/// End of the whole mapping
+	char* end=
+	  base+mappedSize+HUGE_PAGE_SIZE;
+	
+	// Unmap the parts outside the aligned region
+	if(beg!=base)
+	  munmap(base,beg-base);
+	if(beg+mappedSize!=end)
+	  munmap(beg+mappedSize,end-beg-mappedSize);
+	
+	if(madvise(beg,mappedSize,MADV_HUGEPAGE))
+	  {
+	    VERB_LOGGER(1)<<"Unable to advise huge pages for "<<mappedSize<<" bytes: "<<strerror(errno)<<endl;
+	    
+	    kind=
+	      PagesKind::SMALL;
+	  }
+	
+	ptr=
+	  beg;
+      }
+    
+    switch(kind)
+      {
+      case PagesKind::EXPLICIT_HUGE:
+	nExplicitHugePagesAllocs++;
+	VERB_LOGGER(1)<<"Allocated "<<size<<" bytes at "<<ptr<<" with explicit huge pages"<<endl;
+	break;
+      case PagesKind::TRANSPARENT_HUGE:
+	nTransparentHugePagesAllocs++;
+	VERB_LOGGER(1)<<"Allocated "<<size<<" bytes at "<<ptr<<" advising transparent huge pages"<<endl;
+	break;
+      case PagesKind::SMALL:
+	VERB_LOGGER(1)<<"Allocated "<<size<<" bytes at "<<ptr<<" with small pages"<<endl;
+	break;
+      }
+    
+    /// Lock on the list of memory mapped directly
+    std::lock_guard<std::mutex> lock(mappedAllocationsMutex);
+    
+    mappedAllocations[ptr]={mappedSize,kind};
+    nLiveMappedAllocations.fetch_add(1);
+    
+    return
+      ptr;
+  }
+  
+  Size CPUMemoryManager::hugePagesSizeOf(const void* ptr)
+  {
+    /// Description of the mappings of the process
+    std::ifstream smaps("/proc/self/smaps");
+    
+    /// Address to search
+    const uintptr_t address=
+      reinterpret_cast<uintptr_t>(ptr);
+    
+    /// Set when reading the attributes of the mapping containing the address
+    bool isInMapping=
+      false;
+    
+    /// Result
+    Size res=
+      0;
+    
+    /// Line read
+    std::string line;
+    
+    while(std::getline(smaps,line))
+      {
+	/// Bounds of the mapping, if the line opens a new one
+	unsigned long beg,end;
+	
+	if(sscanf(line.c_str(),"%lx-%lx",&beg,&end)==2)
+	  {
+	    if(isInMapping)
+	      break;
+	    
+	    isInMapping=
+	      (beg<=address and address<end);
+	  }
+	else
+	  if(isInMapping)
+	    for(const char* tag : {"AnonHugePages:","Private_Hugetlb:","Shared_Hugetlb:"})
+	      if(line.compare(0,strlen(tag),tag)==0)
+		res+=atol(line.c_str()+strlen(tag))*1024;
+      }
+    
+    return
+      res;
+  }
+  
+  void CPUMemoryManager::printHugePagesReport()
+  {
+    /// Lock on the list of memory mapped directly
+    std::lock_guard<std::mutex> lock(mappedAllocationsMutex);
+    
+    LOGGER<<"Allocations with explicit huge pages: "<<nExplicitHugePagesAllocs<<", "
+      "with transparent huge pages advised: "<<nTransparentHugePagesAllocs<<", "
+      "currently mapped: "<<mappedAllocations.size()<<endl;
+    
+    for(const auto& el : mappedAllocations)
+      {
+	/// Description of the kind of pages
+	const char* kindName=
+	  (el.second.kind==PagesKind::EXPLICIT_HUGE)?"explicit huge pages":
+	  ((el.second.kind==PagesKind::TRANSPARENT_HUGE)?"transparent huge pages":"small pages");
+	
+	LOGGER<<" "<<el.first<<", "<<el.second.size<<" bytes, "<<kindName<<", backed by huge pages: "<<hugePagesSizeOf(el.first)<<" bytes"<<endl;
+      }
+  }
 }
@@ -5,7 +5,17 @@
 ///
 /// \brief Main manager for GPU and CPU memory
 
-#include <map>
+#include <cstdint>
+#include <atomic>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <unordered_map>
 #include <vector>
 
 #ifdef USE_CUDA
@@ -15,6 +25,7 @@
 #include <base/debug.hpp>
 #include <base/feature.hpp>
 #include <base/logger.hpp>
+#include <base/memoryReport.hpp>
 #include <base/metaProgramming.hpp>
 #include <threads/pool.hpp>
 #include <utilities/valueWithExtreme.hpp>
@@ -37,10 +48,99 @@ namespace ciccios
   using Size=
     long int;
   
+  /// Size of a page
+  inline Size getPageSize()
+  {
+    /// Size read from the system
+    static const Size pageSize=
+      sysconf(_SC_PAGESIZE);
+    
+    return
+      pageSize;
+  }
+  
   /// Minimal alignment
 #define DEFAULT_ALIGNMENT 64
   
+  /// Touch in parallel the newly allocated CPU memory
+  EXTERN_MEMORY_MANAGER bool useParallelFirstTouch;
+  
+  /// Use huge pages for large CPU allocations
+  EXTERN_MEMORY_MANAGER bool useHugePages;
+  
+  /// Minimal size of the CPU allocations using huge pages
+  EXTERN_MEMORY_MANAGER Size hugePagesThreshold;
+  
+  /// Size of huge pages
+  constexpr Size HUGE_PAGE_SIZE=1<<21;
+  
+  /// Maximal size of the memory kept in the cache shared among threads, unbounded if zero
+  EXTERN_MEMORY_MANAGER Size memoryCacheBudget;
+  
+  /// Maximal fraction of a cached memory which can be wasted when reusing it for a smaller allocation
+  EXTERN_MEMORY_MANAGER double memoryCacheMaxWaste;
+  
+  /// Number of size classes between two consecutive powers of two
+  ///
+  /// Allocations are rounded up to the size of their class, wasting
+  /// at most the inverse of this number
+  constexpr int N_SIZE_CLASSES_PER_OCTAVE=8;
+  
+  /// Size of the smallest class
+  constexpr Size MIN_SIZE_CLASS_SIZE=DEFAULT_ALIGNMENT;
+  
+  /// Returns the class of an allocation of the given size
+  inline int sizeClassOf(const Size size)
+  {
+    /// Size not smaller than the minimal one
+    const Size s=
+      std::max(size,MIN_SIZE_CLASS_SIZE);
+    
+    /// Exponent of the largest power of two smaller than the size
+    const int octave=
+      63-__builtin_clzl((unsigned long)(s-1));
+    
+    /// Distance between classes in the octave
+    const Size step=
+      ((Size)1<<octave)/N_SIZE_CLASSES_PER_OCTAVE;
+    
+    /// Class inside the octave
+    const int classInOctave=
+      (s-((Size)1<<octave)+step-1)/step-1;
+    
+    return
+      (octave-__builtin_ctzl(MIN_SIZE_CLASS_SIZE))*N_SIZE_CLASSES_PER_OCTAVE+classInOctave+1;
+  }
+  
+  /// Returns the size of the given class, the largest allocation in the class
+  inline Size sizeOfClass(const int sizeClass)
+  {
+    if(sizeClass==0)
+      return MIN_SIZE_CLASS_SIZE;
+    
+    /// Exponent of the power of two opening the octave
+    const int octave=
+      (sizeClass-1)/N_SIZE_CLASSES_PER_OCTAVE+__builtin_ctzl(MIN_SIZE_CLASS_SIZE);
+    
+    /// Class inside the octave
+    const int classInOctave=
+      (sizeClass-1)%N_SIZE_CLASSES_PER_OCTAVE;
+    
+    return
+      ((Size)1<<octave)+((Size)1<<octave)/N_SIZE_CLASSES_PER_OCTAVE*(classInOctave+1);
+  }
+  
   /// Memory manager, base type
+  ///
+  /// Memory can be provided and released by any thread. Each thread
+  /// keeps a small cache of the memory it released, accessed without
+  /// locking, while larger memory goes to a cache shared among
+  /// threads, protected by a lock. The list of the used memory is
+  /// split in shards, each with its own lock.
+  ///
+  /// The shared cache can be limited to a budget, evicting the least
+  /// recently cached memory, and can provide memory of a slightly
+  /// larger size than asked, if none of the exact size is cached.
   template <typename C>
   class BaseMemoryManager
   {
@@ -49,37 +149,244 @@ namespace ciccios
   protected:
     
     /// Number of allocation performed
-    Size nAlloc{0};
+    std::atomic<Size> nAlloc{0};
     
   private:
     
-    /// List of dynamical allocated memory
-    std::map<void*,Size> used;
+    /// Logarithm of the number of shards of the list of used memory
+    static constexpr int LOG2_N_USED_SHARDS=4;
+    
+    /// Number of shards of the list of used memory
+    static constexpr int N_USED_SHARDS=1<<LOG2_N_USED_SHARDS;
+    
+    /// Largest memory kept in the cache of a thread
+    static constexpr Size MAX_FRONT_CACHED_SIZE=1<<20;
     
-    /// List of cached allocated memory
-    std::map<Size,std::vector<void*>> cached;
+    /// Maximal number of memory of each size class kept in the cache of a thread
+    static constexpr int MAX_FRONT_CACHED_PER_CLASS=4;
+    
+    /// Part of the list of the used memory, with its own lock
+    struct alignas(CACHE_LINE_SIZE) UsedShard
+    {
+      /// Protects the list
+      std::mutex mutex;
+      
+      /// Size of the dynamically allocated memory, indexed by pointer
+      std::unordered_map<void*,Size> used;
+    };
+    
+    /// List of the used memory, split in shards according to the pointer
+    UsedShard usedShards[N_USED_SHARDS];
+    
+    /// Cache of a thread, accessed only by the thread without locking
+    struct alignas(CACHE_LINE_SIZE) FrontCache
+    {
+      /// Cached memory, in bins of each size class
+      std::vector<std::vector<void*>> cached;
+      
+      /// Size of cached memory, read by other threads for the statistics
+      std::atomic<Size> cachedSize{0};
+      
+      /// Number of cached memory reused
+      std::atomic<Size> nCachedReused{0};
+    };
+    
+    /// Caches of each thread which used the manager, to be accessed under \c mutex
+    std::vector<std::unique_ptr<FrontCache>> frontCaches;
+    
+    /// Identifier of the manager, used to distinguish it from previously destroyed ones
+    const int64_t id;
+    
+    /// Protects the shared cache and the deferred releases
+    std::mutex mutex;
+    
+    /// Memory in the shared cache
+    struct CachedMemory
+    {
+      /// Cached memory
+      void* ptr;
+      
+      /// Size of the memory, the size of its class
+      Size size;
+    };
+    
+    /// Memory in the shared cache, in order of caching, the least recently cached first
+    std::list<CachedMemory> lru;
+    
+    /// Memory in the shared cache, in bins of each size class, each in order of caching
+    std::vector<std::deque<typename std::list<CachedMemory>::iterator>> cached;
     
     /// Size of used memory
-    ValWithMax<Size> usedSize;
+    std::atomic<Size> usedSize{0};
+    
+    /// Maximal size of used memory
+    std::atomic<Size> maxUsedSize{0};
     
-    /// Size of cached memory
+    /// Number of requests of memory
+    std::atomic<Size> nProvides{0};
+    
+    /// Size of memory cached in the shared cache
     ValWithMax<Size> cachedSize;
     
     /// Use or not cache
     bool useCache{true};
     
-    /// Number of cached memory reused
+    /// Number of memory reused from the shared cache
     Size nCachedReused{0};
     
+    /// Number of memory of a larger class reused from the shared cache
+    Size nBestFitReused{0};
+    
+    /// Size of memory wasted reusing memory of a larger class
+    Size wastedSize{0};
+    
+    /// Number of memory evicted from the shared cache to respect the budget
+    Size nEvictions{0};
+    
+    /// Number of blocks reserved in advance
+    Size nReserved{0};
+    
+    /// Size of memory reserved in advance
+    Size reservedSize{0};
+    
+    /// Size of memory evicted from the shared cache
+    Size evictedSize{0};
+    
+    /// Memory released while works possibly using it were running
+    struct DeferredRelease
+    {
+      /// Released memory
+      void* ptr;
+      
+      /// Size of the memory
+      Size size;
+      
+      /// Epoch of the pool at the moment of the release
+      int64_t epoch;
+    };
+    
+    /// List of released memory not yet reclaimed, in order of release
+    std::vector<DeferredRelease> deferredReleases;
+    
+    /// Size of memory released and not yet reclaimed
+    ValWithMax<Size> deferredSize;
+    
+    /// Number of deferred releases
+    Size nDeferredReleases{0};
+    
+    /// Number of deferred releases not yet reclaimed, to be checked without locking
+    std::atomic<Size> nPendingDeferredReleases{0};
+    
+    /// Statistics of the sites of the allocations, filled if tracking is enabled
+    MemoryTracker tracker;
+    
+    /// Returns a new identifier for a manager
+    static int64_t getNewId()
+    {
+      /// Number of managers created so far
+      static std::atomic<int64_t> nManagers{0};
+      
+      return
+	nManagers++;
+    }
+    
+    /// Returns the cache of the calling thread, creating it at first usage
+    ///
+    /// A thread keeps a cache for each manager it used, so that
+    /// alternating among managers does not create new caches
+    FrontCache& frontCache()
+    {
+      /// Manager used last by the thread
+      thread_local int64_t lastManagerId=-1;
+      
+      /// Cache of the thread for the manager used last
+      thread_local FrontCache* lastCache=nullptr;
+      
+      if(lastManagerId!=id)
+	{
+	  /// Caches of the thread, indexed by the identifier of the manager
+	  thread_local std::unordered_map<int64_t,FrontCache*> caches;
+	  
+	  /// Cache of the thread for this manager
+	  FrontCache*& cache=
+	    caches[id];
+	  
+	  if(cache==nullptr)
+	    {
+	      /// Lock on the shared state
+	      std::lock_guard<std::mutex> lock(mutex);
+	      
+	      frontCaches.emplace_back(new FrontCache);
+	      cache=frontCaches.back().get();
+	    }
+	  
+	  lastCache=cache;
+	  lastManagerId=id;
+	}
+      
+      return
+	*lastCache;
+    }
+    
+    /// Returns the shard of the list of the used memory containing the pointer
+    ///
+    /// The pointer is mixed by a multiplicative hash, whose highest
+    /// bits depend on all the bits of the pointer, so that aligned
+    /// memory is spread over all shards
+    UsedShard& usedShardOf(const void* ptr)
+    {
+      /// Hash of the pointer
+      const uint64_t hash=
+	(reinterpret_cast<uintptr_t>(ptr)/DEFAULT_ALIGNMENT)*0x9e3779b97f4a7c15ull;
+      
+      return
+	usedShards[hash>>(64-LOG2_N_USED_SHARDS)];
+    }
+    
+    /// Move to cache, or free, the memory released
+    ///
+    /// Small memory is put in the cache of the calling thread, if
+    /// there is room, otherwise in the shared cache
+    void reclaim(void* ptr,
+		 const Size size)
+    {
+      if(not useCache)
+	this->deFeat().deAllocateRaw(ptr);
+      else
+	if(not pushToFrontCache(ptr,size))
+	  {
+	    /// Lock on the shared state
+	    std::lock_guard<std::mutex> lock(mutex);
+	    
+	    pushToCache(ptr,size);
+	  }
+    }
+    
     /// Add to the list of used memory
     void pushToUsed(void* ptr,
 		    const Size size)
     {
-      used[ptr]=size;
+      {
+	/// Shard containing the pointer
+	UsedShard& shard=
+	  usedShardOf(ptr);
+	
+	/// Lock on the shard
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	
+	shard.used[ptr]=size;
+      }
       
-      usedSize+=size;
+      /// Size of used memory after the push
+      const Size newUsedSize=
+	(usedSize+=size);
       
-      VERB_LOGGER(3)<<"Pushing to used "<<ptr<<" "<<size<<", used: "<<usedSize<<endl;
+      /// Maximal size seen so far
+      Size prevMax=
+	maxUsedSize.load(std::memory_order_relaxed);
+      while(prevMax<newUsedSize and not maxUsedSize.compare_exchange_weak(prevMax,newUsedSize));
+      
+      VERB_LOGGER(3)<<"Pushing to used "<<ptr<<" "<<size<<", used: "<<newUsedSize<<endl;
     }
     
     /// Removes a pointer from the used list, without actually freeing associated memory
@@ -89,11 +396,18 @@ namespace ciccios
     {
       VERB_LOGGER(3)<<"Popping from used "<<ptr<<endl;
       
+      /// Shard containing the pointer
+      UsedShard& shard=
+	usedShardOf(ptr);
+      
+      /// Lock on the shard
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      
       /// Iterator to search result
       auto el=
-	used.find(ptr);
+	shard.used.find(ptr);
       
-      if(el==used.end())
+      if(el==shard.used.end())
 	CRASHER<<"Unable to find dinamically allocated memory "<<ptr<<endl;
       
       /// Size of memory
@@ -101,21 +415,31 @@ namespace ciccios
       
       usedSize-=size;
       
-      used.erase(el);
+      shard.used.erase(el);
       
       return
 	size;
     }
     
-    /// Adds a memory to cache
-    void pushToCache(void* ptr,          ///< Memory to cache
-		     const Size size)    ///< Memory size
+    /// Adds a memory to the list of the given size class of a thread cache, if there is room
+    static bool pushToBin(std::vector<std::vector<void*>>& cached, ///< Cache where to push
+			  void* ptr,                               ///< Memory to cache
+			  const int& sizeClass,                    ///< Class of the memory
+			  const int& maxPerClass)                  ///< Maximal number of memory to be kept in the class
     {
-      cached[size].push_back(ptr);
+      if((int)cached.size()<=sizeClass)
+	cached.resize(sizeClass+1);
       
-      cachedSize+=size;
+      /// List of the class
+      std::vector<void*>& bin=
+	cached[sizeClass];
       
-      VERB_LOGGER(3)<<"Pushing to cache "<<size<<" "<<ptr<<", cache size: "<<cached.size()<<endl;
+      if((int)bin.size()>=maxPerClass)
+	return false;
+      
+      bin.push_back(ptr);
+      
+      return true;
     }
     
     /// Check if a pointer is suitably aligned
@@ -126,59 +450,204 @@ namespace ciccios
 	reinterpret_cast<uintptr_t>(ptr)%alignment==0;
     }
     
-    /// Pop from the cache, returning to use
-    void* popFromCache(const Size& size,
-		       const Size& alignment)
+    /// Pop from the list of the given size class of a thread cache, if not empty and suitably aligned
+    ///
+    /// Only the latest memory cached in the class is checked for
+    /// alignment, so that the search takes constant time
+    static void* popFromBin(std::vector<std::vector<void*>>& cached, ///< Cache where to search
+			    const int& sizeClass,                    ///< Class of the memory
+			    const Size& alignment)                   ///< Required alignment
     {
-      VERB_LOGGER(3)<<"Try to popping from cache "<<size<<endl;
+      if((int)cached.size()<=sizeClass or cached[sizeClass].size()==0 or not isAligned(cached[sizeClass].back(),alignment))
+	return nullptr;
       
-      /// List of memory with searched size
-      auto cachedIt=
-	cached.find(size);
+      /// Returned pointer
+      void* ptr=
+	cached[sizeClass].back();
       
-      if(cachedIt==cached.end())
+      cached[sizeClass].pop_back();
+      
+      return ptr;
+    }
+    
+    /// Adds a memory to the cache of the calling thread, returns false if there is no room
+    bool pushToFrontCache(void* ptr,          ///< Memory to cache
+			  const Size size)    ///< Memory size, the size of its class
+    {
+      if(size>MAX_FRONT_CACHED_SIZE)
+	return false;
+      
+      /// Cache of the thread
+      FrontCache& front=
+	frontCache();
+      
+      if(not pushToBin(front.cached,ptr,sizeClassOf(size),MAX_FRONT_CACHED_PER_CLASS))
+	return false;
+      
+      front.cachedSize.fetch_add(size,std::memory_order_relaxed);
+      
+      VERB_LOGGER(3)<<"Pushing to the cache of the thread "<<size<<" "<<ptr<<endl;
+      
+      return true;
+    }
+    
+    /// Pop from the cache of the calling thread
+    void* popFromFrontCache(const Size& size,
+			    const Size& alignment)
+    {
+      if(size>MAX_FRONT_CACHED_SIZE)
 	return nullptr;
-      else
+      
+      /// Cache of the thread
+      FrontCache& front=
+	frontCache();
+      
+      /// Returned pointer
+      void* ptr=
+	popFromBin(front.cached,sizeClassOf(size),alignment);
+      
+      if(ptr)
 	{
-	  /// Vector of pointers
-	  auto& list=cachedIt->second;
-	  
-	  /// Get latest cached memory with appropriate alignment
-	  auto it=list.end()-1;
+	  front.cachedSize.fetch_sub(size,std::memory_order_relaxed);
+	  front.nCachedReused.fetch_add(1,std::memory_order_relaxed);
+	}
+      
+      return ptr;
+    }
+    
+    /// Frees the least recently cached memory, to be called holding \c mutex
+    void evictFromCache()
+    {
+      /// Memory to be evicted
+      const CachedMemory& oldest=
+	lru.front();
+      
+      VERB_LOGGER(3)<<"Evicting from cache "<<oldest.size<<" "<<oldest.ptr<<endl;
+      
+      // The oldest memory of the whole cache is also the oldest of its class
+      cached[sizeClassOf(oldest.size)].pop_front();
+      
+      this->deFeat().deAllocateRaw(oldest.ptr);
+      
+      cachedSize-=oldest.size;
+      nEvictions++;
+      evictedSize+=oldest.size;
+      
+      lru.pop_front();
+    }
+    
+    /// Adds a memory to the shared cache, to be called holding \c mutex
+    ///
+    /// The least recently cached memory is freed until there is room
+    /// in the budget. Memory larger than the whole budget is freed
+    /// right away.
+    void pushToCache(void* ptr,          ///< Memory to cache
+		     const Size size)    ///< Memory size, the size of its class
+    {
+      if(memoryCacheBudget>0)
+	{
+	  if(size>memoryCacheBudget)
+	    {
+	      VERB_LOGGER(3)<<"Not caching "<<size<<" "<<ptr<<", larger than the budget"<<endl;
+	      
+	      this->deFeat().deAllocateRaw(ptr);
+	      nEvictions++;
+	      evictedSize+=size;
+	      
+	      return;
+	    }
 	  
-	  while(it!=list.begin()-1 and not isAligned(*it,alignment))
-	    it--;
+	  while(cachedSize+size>memoryCacheBudget)
+	    evictFromCache();
+	}
+      
+      /// Class of the memory
+      const int sizeClass=
+	sizeClassOf(size);
+      
+      if((int)cached.size()<=sizeClass)
+	cached.resize(sizeClass+1);
+      
+      cached[sizeClass].push_back(lru.insert(lru.end(),{ptr,size}));
+      
+      cachedSize+=size;
+      
+      VERB_LOGGER(3)<<"Pushing to cache "<<size<<" "<<ptr<<", cache size: "<<(Size)cachedSize<<endl;
+    }
+    
+    /// Pop from the shared cache, returning to use, to be called holding \c mutex
+    ///
+    /// If no memory of the class of the size is cached, the smallest
+    /// of the larger classes wasting no more than the allowed fraction
+    /// is searched. The size is changed to the one of the memory
+    /// found.
+    void* popFromCache(Size& size,
+		       const Size& alignment)
+    {
+      VERB_LOGGER(3)<<"Try to popping from cache "<<size<<endl;
+      
+      /// Largest size which can be reused
+      const Size maxSize=
+	size+(Size)(size*memoryCacheMaxWaste);
+      
+      for(int sizeClass=sizeClassOf(size);sizeClass<(int)cached.size() and sizeOfClass(sizeClass)<=maxSize;sizeClass++)
+	{
+	  /// Memory of the class
+	  std::deque<typename std::list<CachedMemory>::iterator>& bin=
+	    cached[sizeClass];
 	  
-	  if(it==list.begin()-1)
-	    return nullptr;
-	  else
+	  // Only the latest memory cached in the class is checked for alignment
+	  if(bin.size() and isAligned(bin.back()->ptr,alignment))
 	    {
-	      /// Returned pointer, copied here before erasing
+	      /// Returned pointer
 	      void* ptr=
-		*it;
+		bin.back()->ptr;
+	      
+	      /// Size of the memory found
+	      const Size foundSize=
+		bin.back()->size;
 	      
-	      list.erase(it);
+	      lru.erase(bin.back());
+	      bin.pop_back();
 	      
-	      cachedSize-=size;
+	      cachedSize-=foundSize;
+	      nCachedReused++;
 	      
-	      if(list.size()==0)
-		cached.erase(cachedIt);
+	      if(foundSize!=size)
+		{
+		  nBestFitReused++;
+		  wastedSize+=foundSize-size;
+		  
+		  size=
+		    foundSize;
+		}
 	      
 	      return ptr;
 	    }
 	}
+      
+      return nullptr;
     }
     
-    /// Move the allocated memory to cache
-    void moveToCache(void* ptr) ///< Pointer to the memory to move to cache
+    /// Reclaim the memory released before the given epoch, to be called holding \c mutex
+    void reclaimDeferredReleasesUpTo(const int64_t& completedEpoch)
     {
-      VERB_LOGGER(3)<<"Moving to cache "<<ptr<<endl;
-      
-      /// Size of pointed memory
-      const Size size=
-	popFromUsed(ptr);
+      /// Number of releases which can be reclaimed, the oldest ones
+      size_t n=0;
+      while(n<deferredReleases.size() and deferredReleases[n].epoch<=completedEpoch)
+	{
+	  VERB_LOGGER(3)<<"Reclaiming "<<deferredReleases[n].ptr<<" released at epoch "<<deferredReleases[n].epoch<<endl;
+	  
+	  if(useCache)
+	    pushToCache(deferredReleases[n].ptr,deferredReleases[n].size);
+	  else
+	    this->deFeat().deAllocateRaw(deferredReleases[n].ptr);
+	  deferredSize-=deferredReleases[n].size;
+	  n++;
+	}
       
-      pushToCache(ptr,size);
+      deferredReleases.erase(deferredReleases.begin(),deferredReleases.begin()+n);
+      nPendingDeferredReleases.store(deferredReleases.size(),std::memory_order_relaxed);
     }
     
   public:
@@ -190,6 +659,8 @@ namespace ciccios
     }
     
     /// Disable cache usage
+    ///
+    /// To be called when no other thread is using the manager
     void disableCache()
     {
       useCache=
@@ -199,45 +670,150 @@ namespace ciccios
     }
     
     /// Allocate or get from cache after computing the proper size
+    ///
+    /// Can be called by any thread. The cache of the calling thread
+    /// is searched first, then the shared one. If \a warm is true,
+    /// all pages are touched before returning, so that no page fault
+    /// happens at first usage. The file and line of the caller are
+    /// used to track the allocation, if enabled.
     template <class T>
     T* provide(const Size nel,
-	       const Size alignment=DEFAULT_ALIGNMENT)
+	       const Size alignment=DEFAULT_ALIGNMENT,
+	       const bool warm=false,
+	       const char* file=__builtin_FILE(),
+	       const int line=__builtin_LINE())
     {
-      /// Total size to allocate
-      const Size size=
-	sizeof(T)*nel;
+      /// Total size to allocate, rounded to the size of its class, or of the larger cached memory reused
+      Size size=
+	sizeOfClass(sizeClassOf(sizeof(T)*nel));
       
-      /// Allocated memory
-      void* ptr;
+      reclaimDeferredReleases();
       
-      // Search in the cache
-      ptr=
-	popFromCache(size,alignment);
+      /// Allocated memory, searched first in the cache of the thread
+      void* ptr=
+	popFromFrontCache(size,alignment);
+      
+      // Search in the shared cache
+      if(ptr==nullptr)
+	{
+	  /// Lock on the shared state
+	  std::lock_guard<std::mutex> lock(mutex);
+	  
+	  ptr=
+	    popFromCache(size,alignment);
+	}
       
       // If not found in the cache, allocate new memory
       if(ptr==nullptr)
 	ptr=
 	  this->deFeat().allocateRaw(size,alignment);
-      else
-	nCachedReused++;
+      
+      if(warm)
+	this->deFeat().prefault(ptr,size);
       
       pushToUsed(ptr,size);
       
+      if(useMemoryTracking)
+	tracker.recordProvide(ptr,size,file,line);
+      
+      nProvides.fetch_add(1,std::memory_order_relaxed);
+      
       return static_cast<T*>(ptr);
     }
     
+    /// Number of requests of memory served so far, either allocating or reusing memory
+    Size getNProvides()
+      const
+    {
+      return
+	nProvides.load(std::memory_order_relaxed);
+    }
+    
+    /// Fill the shared cache with memory of the given size, with all pages already resident
+    ///
+    /// To be called before the timed part of a program, with the
+    /// sizes it will need, so that neither the allocation nor the
+    /// page faults are paid later. The budget of the cache, if any, is
+    /// respected, so reserving too much evicts the older memory.
+    void reserve(const Size size,                      ///< Size of each block
+		 const int nBlocks,                    ///< Number of blocks
+		 const Size alignment=DEFAULT_ALIGNMENT) ///< Required alignment
+    {
+      /// Size of each block, rounded to the size of its class
+      const Size blockSize=
+	sizeOfClass(sizeClassOf(size));
+      
+      /// Reserved memory, all allocated before being cached
+      std::vector<void*> ptrs(nBlocks);
+      
+      for(void*& ptr : ptrs)
+	{
+	  ptr=
+	    this->deFeat().allocateRaw(blockSize,alignment);
+	  
+	  this->deFeat().prefault(ptr,blockSize);
+	}
+      
+      /// Lock on the shared state
+      std::lock_guard<std::mutex> lock(mutex);
+      
+      for(void* ptr : ptrs)
+	pushToCache(ptr,blockSize);
+      
+      nReserved+=nBlocks;
+      reservedSize+=nBlocks*blockSize;
+    }
+    
+    /// Reclaim the memory released before the latest completed epoch of the pool
+    ///
+    /// If \a all is true, reclaim all memory, assuming no work is
+    /// running. Any thread not executing a work can reclaim memory,
+    /// the lock is taken only if some release has been deferred.
+    void reclaimDeferredReleases(const bool all=false)
+    {
+      if(ThreadPool::isInsideWork() or nPendingDeferredReleases.load(std::memory_order_relaxed)==0)
+	return;
+      
+      /// Lock on the shared state
+      std::lock_guard<std::mutex> lock(mutex);
+      
+      if(deferredReleases.size())
+	reclaimDeferredReleasesUpTo(all?std::numeric_limits<int64_t>::max():ThreadPool::getCompletedPoolEpoch());
+    }
+    
     /// Declare unused the memory and possibly free it
+    ///
+    /// If works dispatched to the pool might still be using the
+    /// memory, it is queued and reclaimed only when the pool has
+    /// completed them, without waiting. Memory released inside a
+    /// work is reclaimed immediately.
     template <typename T>
     void release(T* &ptr) ///< Pointer getting freed
     {
-      ThreadPool::waitThatAllWorkersWaitForWork();
+      /// Size of the memory
+      const Size size=
+	popFromUsed(static_cast<void*>(ptr));
       
-      if(useCache)
-	moveToCache(static_cast<void*>(ptr));
+      if(useMemoryTracking)
+	tracker.recordRelease(static_cast<void*>(ptr));
+      
+      /// Epoch of the pool
+      const int64_t epoch=
+	ThreadPool::getPoolEpoch();
+      
+      if(ThreadPool::isInsideWork() or epoch<=ThreadPool::getCompletedPoolEpoch())
+	reclaim(static_cast<void*>(ptr),size);
       else
 	{
-	  popFromUsed(ptr);
-	  this->deFeat().deAllocateRaw(static_cast<void*>(ptr));
+	  VERB_LOGGER(3)<<"Deferring the release of "<<(void*)ptr<<" to the completion of epoch "<<epoch<<endl;
+	  
+	  /// Lock on the shared state
+	  std::lock_guard<std::mutex> lock(mutex);
+	  
+	  deferredReleases.push_back({static_cast<void*>(ptr),size,epoch});
+	  deferredSize+=size;
+	  nDeferredReleases++;
+	  nPendingDeferredReleases.store(deferredReleases.size(),std::memory_order_relaxed);
 	}
       
       ptr=
@@ -245,77 +821,171 @@ namespace ciccios
     }
     
     /// Release all used memory
+    ///
+    /// To be called when no other thread is using the manager
     void releaseAllUsedMemory()
     {
-      /// Iterator on elements to release
-      auto el=
-	used.begin();
-      
-      while(el!=used.end())
+      for(UsedShard& shard : usedShards)
 	{
-	  VERB_LOGGER(3)<<"Releasing "<<el->first<<" size "<<el->second<<endl;
-	  
-	  /// Pointer to memory to release
-	  void* ptr=el->first;
+	  /// Memory to be released, collected before releasing, which modifies the list
+	  std::vector<void*> ptrs;
 	  
-	  // Increment iterator before releasing
-	  el++;
+	  for(const auto& el : shard.used)
+	    {
+	      VERB_LOGGER(3)<<"Releasing "<<el.first<<" size "<<el.second<<endl;
+	      
+	      ptrs.push_back(el.first);
+	    }
 	  
-	  this->deFeat().release(ptr);
+	  for(void* ptr : ptrs)
+	    this->deFeat().release(ptr);
 	}
     }
     
     /// Release all memory from cache
+    ///
+    /// The caches of all threads are emptied, so this must be called
+    /// when no other thread is using the manager
     void clearCache()
     {
       VERB_LOGGER(3)<<"Clearing cache"<<endl;
       
-      /// Iterator to elements of the cached memory list
-      auto el=
-	cached.begin();
+      /// Lock on the shared state
+      std::lock_guard<std::mutex> lock(mutex);
       
-      while(el!=cached.end())
+      for(const CachedMemory& c : lru)
 	{
-	  /// Number of elements to free
-	  const Size n=
-	    el->second.size();
-	  
-	  /// Size to be removed
-	  const Size size=
-	    el->first;
-	  
-	  // Increment before erasing
-	  el++;
-	  
-	  for(Size i=0;i<n;i++)
+	  VERB_LOGGER(3)<<"Removing from cache "<<c.ptr<<endl;
+	  this->deFeat().deAllocateRaw(c.ptr);
+	}
+      
+      lru.clear();
+      cached.clear();
+      cachedSize=0;
+      
+      for(std::unique_ptr<FrontCache>& front : frontCaches)
+	{
+	  for(std::vector<void*>& bin : front->cached)
 	    {
-	      VERB_LOGGER(3)<<"Removing from cache size  "<<el->first<<endl;
+	      for(void* ptr : bin)
+		{
+		  VERB_LOGGER(3)<<"Removing from cache "<<ptr<<endl;
+		  this->deFeat().deAllocateRaw(ptr);
+		}
 	      
-	      /// Memory to free
-	      void* ptr=
-		popFromCache(size,DEFAULT_ALIGNMENT);
-	      
-	      VERB_LOGGER(3)<<"ptr: "<<ptr<<endl;
-	      this->deFeat().deAllocateRaw(ptr);
+	      bin.clear();
 	    }
+	  
+	  front->cachedSize=0;
 	}
     }
     
+    /// Number of memory reused from the shared cache
+    Size getNCachedReused()
+    {
+      /// Lock on the shared state
+      std::lock_guard<std::mutex> lock(mutex);
+      
+      return
+	nCachedReused;
+    }
+    
+    /// Number of memory of a larger class reused from the shared cache
+    Size getNBestFitReused()
+    {
+      /// Lock on the shared state
+      std::lock_guard<std::mutex> lock(mutex);
+      
+      return
+	nBestFitReused;
+    }
+    
+    /// Number of memory evicted from the shared cache to respect the budget
+    Size getNEvictions()
+    {
+      /// Lock on the shared state
+      std::lock_guard<std::mutex> lock(mutex);
+      
+      return
+	nEvictions;
+    }
+    
+    /// Number of caches of the threads
+    int64_t getNFrontCaches()
+    {
+      /// Lock on the shared state
+      std::lock_guard<std::mutex> lock(mutex);
+      
+      return
+	frontCaches.size();
+    }
+    
     /// Print to a stream
+    ///
+    /// The statistics of the caches of all threads are summed
     void printStatistics()
     {
+      /// Lock on the shared state
+      std::lock_guard<std::mutex> lock(mutex);
+      
+      /// Memory cached by the threads
+      Size frontCachedSize=0;
+      
+      /// Number of reuses of memory cached by the threads
+      Size frontCachedReused=0;
+      
+      for(const std::unique_ptr<FrontCache>& front : frontCaches)
+	{
+	  frontCachedSize+=front->cachedSize.load(std::memory_order_relaxed);
+	  frontCachedReused+=front->nCachedReused.load(std::memory_order_relaxed);
+	}
+      
+      /// Number of memory reused from any cache
+      const Size nReused=
+	nCachedReused+frontCachedReused;
+      
+      /// Number of requests of memory
+      const Size nRequests=
+	nReused+nAlloc;
+      
       LOGGER<<
-	"Maximal memory used: "<<usedSize.extreme()<<" bytes, "
-	"currently used: "<<(Size)usedSize<<" bytes, "
+	"Maximal memory used: "<<maxUsedSize<<" bytes, "
+	"currently used: "<<usedSize<<" bytes, "
 	"maxcached: "<<cachedSize.extreme()<<" bytes, "
 	"currently cached: "<<(Size)cachedSize<<" bytes, "
-	"number of reused: "<<nCachedReused<<endl;
+	"cached by "<<frontCaches.size()<<" threads: "<<frontCachedSize<<" bytes, "
+	"number of reused: "<<nReused<<", "
+	"hit rate: "<<(nRequests?(double)nReused/nRequests:0.0)<<", "
+	"reused from a larger class: "<<nBestFitReused<<" wasting "<<wastedSize<<" bytes, "
+	"evicted: "<<nEvictions<<" for "<<evictedSize<<" bytes, "
+	"reserved: "<<nReserved<<" for "<<reservedSize<<" bytes, "
+	"number of deferred releases: "<<nDeferredReleases<<", "
+	"max deferred: "<<deferredSize.extreme()<<" bytes"<<endl;
+    }
+    
+    /// Write the report of the sites of the allocations to the given stream
+    void writeReport(std::ostream& out)
+    {
+      tracker.writeJson(out);
+    }
+    
+    /// Write the report of the sites of the allocations to the given path
+    void writeReport(const std::string& path)
+    {
+      /// File where to write
+      std::ofstream out(path);
+      
+      if(not out.good())
+	CRASHER<<"Unable to open "<<path<<" to write the memory report"<<endl;
+      
+      writeReport(out);
     }
     
     /// Create the memory manager
     BaseMemoryManager() :
-      usedSize(0),
-      cachedSize(0)
+      id(getNewId()),
+      cachedSize(0),
+      deferredSize(0)
     {
       LOGGER<<"Starting the memory manager"<<endl;
     }
@@ -327,6 +997,10 @@ namespace ciccios
       
       printStatistics();
       
+      // Any work using the memory must have been completed
+      ThreadPool::waitThatAllWorkersWaitForWork();
+      reclaimDeferredReleases(true);
+      
       releaseAllUsedMemory();
       
       clearCache();
@@ -336,6 +1010,112 @@ namespace ciccios
   /// Manager of CPU memory
   struct CPUMemoryManager : public BaseMemoryManager<CPUMemoryManager>
   {
+    /// Kind of pages backing an allocation
+    enum class PagesKind{SMALL,EXPLICIT_HUGE,TRANSPARENT_HUGE};
+    
+    /// Memory mapped directly, to be unmapped when freed
+    struct MappedAllocation
+    {
+      /// Size of the mapping
+      Size size;
+      
+      /// Kind of pages asked
+      PagesKind kind;
+    };
+    
+    /// Memory mapped directly, indexed by pointer
+    std::unordered_map<void*,MappedAllocation> mappedAllocations;
+    
+    /// Protects the list of memory mapped directly
+    std::mutex mappedAllocationsMutex;
+    
+    /// Number of allocations mapped directly and not yet unmapped, to skip the search when zero
+    std::atomic<Size> nLiveMappedAllocations{0};
+    
+    /// Number of allocations with explicit huge pages
+    std::atomic<Size> nExplicitHugePagesAllocs{0};
+    
+    /// Number of allocations for which transparent huge pages have been advised
+    std::atomic<Size> nTransparentHugePagesAllocs{0};
+    
+    /// Map memory backed by huge pages
+    ///
+    /// Explicit huge pages are asked first, which succeeds only if
+    /// the administrator reserved them. Otherwise a region aligned to
+    /// the huge page size is mapped and the kernel is advised to back
+    /// it with transparent huge pages. Returns null if both fail.
+    void* allocateHugePages(const Size size);
+    
+    /// Returns the amount of memory backed by huge pages in the mapping containing the pointer
+    ///
+    /// Read from /proc/self/smaps. Transparent huge pages are
+    /// obtained only when memory is touched, and adjacent mappings
+    /// might have been merged by the kernel.
+    static Size hugePagesSizeOf(const void* ptr);
+    
+    /// Print, for each allocation mapped directly, the kind of pages asked and the memory actually backed by huge pages
+    void printHugePagesReport();
+    
+    /// Touch the memory in parallel, placing each page on the NUMA node of the thread touching it
+    ///
+    /// The pages are split among threads as \c loopSplit does with
+    /// the elements, so the thread later working on a chunk of a
+    /// field finds it on its own node. Small allocations are not
+    /// worth a parallel dispatch and are skipped.
+    void firstTouchInParallel(void* ptr,        ///< Memory to touch
+			      const Size size)  ///< Amount of memory
+    {
+      /// Size of a page
+      const Size pageSize=
+	getPageSize();
+      
+      if(ThreadPool::canDispatchWork() and size>=nThreads*pageSize)
+	{
+	  /// Beginning of the memory
+	  char* beg=
+	    static_cast<char*>(ptr);
+	  
+	  /// Beginning of the first page
+	  char* firstPage=
+	    beg-(reinterpret_cast<uintptr_t>(beg)%pageSize);
+	  
+	  /// Number of pages to be touched
+	  const Size nPages=
+	    (beg+size-firstPage+pageSize-1)/pageSize;
+	  
+	  ThreadPool::loopSplit((Size)0,nPages,[beg,firstPage,pageSize](const Size& iPage)
+					       {
+						 *std::max(beg,firstPage+iPage*pageSize)=0;
+					       });
+	  
+	  ThreadPool::waitThatAllWorkersWaitForWork();
+	}
+    }
+    
+    /// Makes all the pages of the memory resident, touching them
+    ///
+    /// Pages are touched in parallel when possible, otherwise by the
+    /// calling thread. The content of the memory is changed.
+    void prefault(void* ptr,        ///< Memory to touch
+		  const Size size)  ///< Amount of memory
+    {
+      /// Size of a page
+      const Size pageSize=
+	getPageSize();
+      
+      if(ThreadPool::canDispatchWork() and size>=nThreads*pageSize)
+	firstTouchInParallel(ptr,size);
+      else
+	{
+	  /// Beginning of the memory
+	  char* beg=
+	    static_cast<char*>(ptr);
+	  
+	  for(char* p=beg;p<beg+size;p+=pageSize-reinterpret_cast<uintptr_t>(p)%pageSize)
+	    *static_cast<volatile char*>(p)=0;
+	}
+    }
+    
     /// Get memory
     ///
     /// Call the system routine which allocate memory
@@ -345,14 +1125,23 @@ namespace ciccios
       /// Result
       void* ptr=nullptr;
       
-      /// Returned condition
-      VERB_LOGGER(3)<<"Allocating size "<<size<<" on CPU"<<endl;
-      int rc=
-	posix_memalign(&ptr,alignment,size);
-      if(rc)
-	CRASHER<<"Failed to allocate "<<size<<" CPU memory with alignement "<<alignment<<endl;
+      if(useHugePages and size>=hugePagesThreshold and alignment<=HUGE_PAGE_SIZE)
+	ptr=allocateHugePages(size);
+      
+      if(ptr==nullptr)
+	{
+	  /// Returned condition
+	  VERB_LOGGER(3)<<"Allocating size "<<size<<" on CPU"<<endl;
+	  int rc=
+	    posix_memalign(&ptr,alignment,size);
+	  if(rc)
+	    CRASHER<<"Failed to allocate "<<size<<" CPU memory with alignement "<<alignment<<endl;
+	}
       VERB_LOGGER(3)<<"ptr: "<<ptr<<endl;
       
+      if(useParallelFirstTouch)
+	firstTouchInParallel(ptr,size);
+      
       nAlloc++;
       
       return ptr;
@@ -362,6 +1151,28 @@ namespace ciccios
     void deAllocateRaw(void* ptr)
     {
       VERB_LOGGER(3)<<"Freeing from CPU memory "<<ptr<<endl;
+      
+      if(nLiveMappedAllocations.load()>0)
+	{
+	  /// Lock on the list of memory mapped directly
+	  std::lock_guard<std::mutex> lock(mappedAllocationsMutex);
+	  
+	  /// Search the memory among the mapped ones
+	  auto el=
+	    mappedAllocations.find(ptr);
+	  
+	  if(el!=mappedAllocations.end())
+	    {
+	      if(munmap(ptr,el->second.size))
+		CRASHER<<"Failed to unmap "<<ptr<<endl;
+	      
+	      mappedAllocations.erase(el);
+	      nLiveMappedAllocations.fetch_sub(1);
+	      
+	      return;
+	    }
+	}
+      
       free(ptr);
     }
   };
@@ -392,6 +1203,12 @@ namespace ciccios
       return ptr;
     }
     
+    /// Memory on GPU is always resident
+    void prefault(void*,
+		  const Size)
+    {
+    }
+    
     /// Properly free
     void deAllocateRaw(void* ptr)
     {
@@ -407,8 +1224,8 @@ namespace ciccios
   
   /////////////////////////////////////////////////////////////////
   
-  /// Position where to store the data: device or host
-  enum class StorLoc{ON_CPU,ON_GPU};
+  /// Position where to store the data: device, host, or file mapped on host
+  enum class StorLoc{ON_CPU,ON_GPU,ON_FILE};
   
   /// Tag do distinguish CPU or GPU storage
   ///
@@ -421,6 +1238,9 @@ namespace ciccios
       case StorLoc::ON_CPU:
 	return "CPU";
 	break;
+      case StorLoc::ON_FILE:
+	return "FILE";
+	break;
       case StorLoc::ON_GPU:
       default:
 	return "GPU";
@@ -428,6 +1248,11 @@ namespace ciccios
       }
   }
   
+  /// Check whether the data is stored in the host memory, possibly mapped from a file
+  template <StorLoc SL>
+  constexpr bool isOnHost=
+    SL==StorLoc::ON_CPU or SL==StorLoc::ON_FILE;
+  
   /// Wraps the memory manager
   ///
   /// Forward definition
@@ -0,0 +1,151 @@
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+/// \file memoryReport.cpp
+///
+/// \brief Implements the tracking of the allocation sites
+
+#define EXTERN_MEMORY_REPORT
+# include "base/memoryReport.hpp"
+
+#include <algorithm>
+
+namespace ciccios
+{
+  void MemoryTracker::recordProvide(void* ptr,
+				    const int64_t size,
+				    const char* file,
+				    const int line)
+  {
+    /// Name of the site
+    const std::string name=
+      resources::memoryLabel?
+      std::string(resources::memoryLabel):
+      (std::string(file)+":"+std::to_string(line));
+    
+    /// Lock on the statistics
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    /// Site of the allocation, created if not yet seen, with no memory at the latest peak
+    auto site=
+      sites.emplace(name,Site{}).first;
+    
+    Site& s=
+      site->second;
+    
+    if(s.nAllocs==0)
+      s.iPeakOfSnapshot=nPeaks;
+    
+    s.updateSnapshot(nPeaks);
+    s.nAllocs++;
+    s.totalSize+=size;
+    s.nLive++;
+    s.liveSize+=size;
+    s.maxLiveSize=std::max(s.maxLiveSize,s.liveSize);
+    
+    live[ptr]={size,site};
+    
+    histogram[63-__builtin_clzl((unsigned long)std::max(size,(int64_t)1))]++;
+    
+    usedSize+=size;
+    
+    if(usedSize>peakSize)
+      {
+	// Record in the timeline only peaks larger by at least 1/16 of the latest recorded
+	if(peaks.size()<MAX_PEAK_EVENTS and (peaks.size()==0 or usedSize>=peaks.back().usedSize+peaks.back().usedSize/16))
+	  peaks.push_back({timeDiffInSec(takeTime(),origin),usedSize,name});
+	
+	peakSize=
+	  usedSize;
+	
+	nPeaks++;
+      }
+  }
+  
+  void MemoryTracker::recordRelease(void* ptr)
+  {
+    /// Lock on the statistics
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    /// Search the allocation
+    auto el=
+      live.find(ptr);
+    
+    if(el==live.end())
+      return;
+    
+    Site& s=
+      el->second.site->second;
+    
+    s.updateSnapshot(nPeaks);
+    s.nLive--;
+    s.liveSize-=el->second.size;
+    
+    usedSize-=el->second.size;
+    
+    live.erase(el);
+  }
+  
+  /// Write a string in JSON format, escaping quotes and backslashes
+  static void writeJsonString(std::ostream& os,
+			      const std::string& str)
+  {
+    os<<'"';
+    for(const char& c : str)
+      {
+	if(c=='"' or c=='\\')
+	  os<<'\\';
+	os<<c;
+      }
+    os<<'"';
+  }
+  
+  void MemoryTracker::writeJson(std::ostream& os)
+  {
+    /// Lock on the statistics
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    os<<"{\n";
+    os<<" \"usedSize\": "<<usedSize<<",\n";
+    os<<" \"peakSize\": "<<peakSize<<",\n";
+    os<<" \"nLive\": "<<live.size()<<",\n";
+    
+    os<<" \"sites\": [";
+    for(auto el=sites.begin();el!=sites.end();el++)
+      {
+	/// Statistics of the site, with the size at the latest peak brought up to date
+	Site& s=
+	  el->second;
+	
+	s.updateSnapshot(nPeaks);
+	
+	os<<(el==sites.begin()?"\n":",\n")<<"  {\"name\": ";
+	writeJsonString(os,el->first);
+	os<<", \"nAllocs\": "<<s.nAllocs<<", \"totalSize\": "<<s.totalSize<<
+	  ", \"nLive\": "<<s.nLive<<", \"liveSize\": "<<s.liveSize<<
+	  ", \"maxLiveSize\": "<<s.maxLiveSize<<", \"liveSizeAtPeak\": "<<s.liveSizeAtPeak<<"}";
+      }
+    os<<"\n ],\n";
+    
+    os<<" \"sizeHistogram\": [";
+    bool first=true;
+    for(int iBin=0;iBin<N_HISTOGRAM_BINS;iBin++)
+      if(histogram[iBin])
+	{
+	  os<<(first?"\n":",\n")<<"  {\"minSize\": "<<((int64_t)1<<iBin)<<", \"nAllocs\": "<<histogram[iBin]<<"}";
+	  first=false;
+	}
+    os<<"\n ],\n";
+    
+    os<<" \"peaks\": [";
+    for(size_t iPeak=0;iPeak<peaks.size();iPeak++)
+      {
+	os<<(iPeak==0?"\n":",\n")<<"  {\"time\": "<<peaks[iPeak].time<<", \"usedSize\": "<<peaks[iPeak].usedSize<<", \"site\": ";
+	writeJsonString(os,peaks[iPeak].site);
+	os<<"}";
+      }
+    os<<"\n ]\n";
+    os<<"}\n";
+  }
+}
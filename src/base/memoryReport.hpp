@@ -0,0 +1,205 @@
+#ifndef _MEMORY_REPORT_HPP
+#define _MEMORY_REPORT_HPP
+
+/// \file memoryReport.hpp
+///
+/// \brief Tracks the place in the code where memory is allocated
+///
+/// When enabled through the MEMORY_TRACKING flag, each memory
+/// provided by a memory manager is attributed to a site: the label of
+/// the innermost \c MemoryLabelScope open in the thread, if any, the
+/// type of the tensor for the data of tensors and fields, or the file
+/// and line of the call to \c provide. For each site the
+/// live and peak memory is kept, together with a histogram of the
+/// sizes and a timeline of the moments at which the used memory
+/// reached a new peak. The report is written in JSON, at the end if
+/// asked through the MEMORY_REPORT_FILE flag, or on demand.
+
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <base/debug.hpp>
+
+#ifndef EXTERN_MEMORY_REPORT
+# define EXTERN_MEMORY_REPORT extern
+#endif
+
+namespace ciccios
+{
+  /// Take note of the site of each allocation
+  EXTERN_MEMORY_REPORT bool useMemoryTracking;
+  
+  /// File where to write the report at the end, suffixed with the kind of memory and the rank, not written if empty
+  EXTERN_MEMORY_REPORT std::string memoryReportFile;
+  
+  namespace resources
+  {
+    /// Label of the innermost scope open in the thread
+    EXTERN_MEMORY_REPORT thread_local const char* memoryLabel;
+  }
+  
+  /// Attributes to a label all the memory provided by the thread during the lifetime of the scope
+  ///
+  /// To be used to name fields or temporaries, whose memory would be
+  /// otherwise attributed to the place where the storage is
+  /// allocated. Scopes can be nested, the innermost label is used.
+  class MemoryLabelScope
+  {
+    /// Label of the enclosing scope
+    const char* const prevLabel;
+    
+  public:
+    
+    /// Opens the scope, the label must live as long as the scope
+    MemoryLabelScope(const char* label) :
+      prevLabel(resources::memoryLabel)
+    {
+      resources::memoryLabel=label;
+    }
+    
+    /// Closes the scope, restoring the label of the enclosing one
+    ~MemoryLabelScope()
+    {
+      resources::memoryLabel=prevLabel;
+    }
+    
+    /// Forbids copying the scope
+    MemoryLabelScope(const MemoryLabelScope&)=delete;
+  };
+  
+  /// Keeps the statistics of the allocations of a memory manager, divided by site
+  class MemoryTracker
+  {
+    /// Maximal number of events kept in the timeline of the peaks
+    static constexpr int MAX_PEAK_EVENTS=1000;
+    
+    /// Number of bins of the histogram of sizes, one for each power of two
+    static constexpr int N_HISTOGRAM_BINS=64;
+    
+    /// Statistics of a site
+    struct Site
+    {
+      /// Number of allocations
+      int64_t nAllocs{0};
+      
+      /// Total size allocated
+      int64_t totalSize{0};
+      
+      /// Number of live allocations
+      int64_t nLive{0};
+      
+      /// Size of live allocations
+      int64_t liveSize{0};
+      
+      /// Maximal size of live allocations
+      int64_t maxLiveSize{0};
+      
+      /// Size of live allocations at the moment of the peak of the used memory, if up to date
+      int64_t liveSizeAtPeak{0};
+      
+      /// Number of the peak at which \c liveSizeAtPeak was last updated
+      int64_t iPeakOfSnapshot{0};
+      
+      /// Brings up to date the size at the latest peak, to be called before changing the live size
+      ///
+      /// If the live size has not changed since before the latest
+      /// peak, its current value is the one at the peak
+      void updateSnapshot(const int64_t& iPeak)
+      {
+	if(iPeakOfSnapshot!=iPeak)
+	  {
+	    liveSizeAtPeak=liveSize;
+	    iPeakOfSnapshot=iPeak;
+	  }
+      }
+    };
+    
+    /// Allocation not yet released
+    struct LiveAllocation
+    {
+      /// Size of the allocation
+      int64_t size;
+      
+      /// Site of the allocation, as an element of \c sites
+      std::map<std::string,Site>::iterator site;
+    };
+    
+    /// Moment at which the used memory reached a new peak
+    struct PeakEvent
+    {
+      /// Time elapsed since the creation of the tracker, in seconds
+      double time;
+      
+      /// Used memory
+      int64_t usedSize;
+      
+      /// Site of the allocation reaching the peak
+      std::string site;
+    };
+    
+    /// Protects all the statistics
+    std::mutex mutex;
+    
+    /// Creation of the tracker
+    const Instant origin;
+    
+    /// Statistics of each site, indexed by name
+    std::map<std::string,Site> sites;
+    
+    /// Allocations not yet released, indexed by pointer
+    std::unordered_map<void*,LiveAllocation> live;
+    
+    /// Number of allocations with size between consecutive powers of two
+    int64_t histogram[N_HISTOGRAM_BINS]{};
+    
+    /// Timeline of the peaks, recorded only when growing appreciably
+    std::vector<PeakEvent> peaks;
+    
+    /// Used memory
+    int64_t usedSize{0};
+    
+    /// Maximal used memory
+    int64_t peakSize{0};
+    
+    /// Number of times the used memory reached a new peak
+    ///
+    /// The size of each site at the peak is updated only when it
+    /// changes, so that a new peak takes constant time
+    int64_t nPeaks{0};
+    
+  public:
+    
+    /// Creates the tracker, starting the clock of the timeline
+    MemoryTracker() :
+      origin(takeTime())
+    {
+    }
+    
+    /// Take note of memory provided
+    ///
+    /// The site is the label of the innermost open scope, or the file and line
+    void recordProvide(void* ptr,
+		       const int64_t size,
+		       const char* file,
+		       const int line);
+    
+    /// Take note of memory released, ignoring memory provided while tracking was disabled
+    void recordRelease(void* ptr);
+    
+    /// Write the report in JSON format
+    void writeJson(std::ostream& os);
+  };
+}
+
+#undef EXTERN_MEMORY_REPORT
+
+#endif
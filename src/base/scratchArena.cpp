@@ -0,0 +1,82 @@
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+/// \file scratchArena.cpp
+///
+/// \brief Defines the arena of each thread
+
+#define EXTERN_SCRATCH_ARENA
+# include "base/scratchArena.hpp"
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <base/logger.hpp>
+#include <threads/pool.hpp>
+
+namespace ciccios
+{
+  /// Allocations served by the arena in all the scopes with a given name
+  struct ArenaScopeStatistics
+  {
+    /// Number of scopes closed
+    int64_t nScopes{0};
+    
+    /// Number of allocations served
+    int64_t nProvides{0};
+    
+    /// Size of memory served
+    int64_t providedSize{0};
+  };
+  
+  namespace resources
+  {
+    /// Protects the statistics of the scopes
+    std::mutex arenaScopeStatisticsMutex;
+    
+    /// Statistics of the scopes, indexed by name
+    std::map<std::string,ArenaScopeStatistics> arenaScopeStatistics;
+  }
+  
+  ArenaScope::~ArenaScope()
+  {
+    ThreadPool::waitWorksInFlight();
+    
+    if(name)
+      accountStatistics();
+    
+    if(outer)
+      {
+	outer->nProvides+=nProvides;
+	outer->providedSize+=providedSize;
+      }
+    
+    resources::arenaScope=outer;
+  }
+  
+  void ArenaScope::accountStatistics()
+  {
+    /// Lock on the statistics
+    std::lock_guard<std::mutex> lock(resources::arenaScopeStatisticsMutex);
+    
+    /// Statistics of the scopes with this name
+    ArenaScopeStatistics& stat=
+      resources::arenaScopeStatistics[name];
+    
+    stat.nScopes++;
+    stat.nProvides+=nProvides;
+    stat.providedSize+=providedSize;
+  }
+  
+  void printArenaScopeStatistics()
+  {
+    /// Lock on the statistics
+    std::lock_guard<std::mutex> lock(resources::arenaScopeStatisticsMutex);
+    
+    for(const auto& el : resources::arenaScopeStatistics)
+      LOGGER<<"Arena scope "<<el.first<<": "<<el.second.nScopes<<" times, "
+	"memory manager provides avoided: "<<el.second.nProvides<<" for "<<el.second.providedSize<<" bytes"<<endl;
+  }
+}
@@ -0,0 +1,318 @@
+#ifndef _SCRATCH_ARENA_HPP
+#define _SCRATCH_ARENA_HPP
+
+/// \file scratchArena.hpp
+///
+/// \brief Per-thread bump allocator for the temporaries of kernels
+///
+/// Each thread owns an arena, a buffer allocated at first usage by
+/// the thread itself, so that on NUMA machines it is placed close to
+/// the thread. Memory is provided by advancing an offset, and is
+/// given back all at once when the \c ScratchArenaScope which was
+/// open at the moment of the allocation is closed. No lock is
+/// needed, and the arena can be used inside the body of a loop run
+/// by the pool, differently from the memory manager. The temporaries
+/// of tensors which might go on the arena are taken from it when
+/// there is room, otherwise from the memory manager. An
+/// \c ArenaScope additionally collects statistics of the memory
+/// provided by the arena to the temporaries created in the thread
+/// during its lifetime.
+
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+#include <base/debug.hpp>
+#include <base/inliner.hpp>
+#include <threads/loopSchedule.hpp>
+
+#ifndef EXTERN_SCRATCH_ARENA
+# define EXTERN_SCRATCH_ARENA extern
+#endif
+
+namespace ciccios
+{
+  /// Size of the scratch arena of each thread, in bytes
+  EXTERN_SCRATCH_ARENA int64_t scratchArenaSize;
+  
+  /// Bump allocator owned by a thread
+  class ScratchArena
+  {
+    /// Buffer from which memory is provided, allocated at first usage
+    char* buffer;
+    
+    /// Size of the buffer
+    int64_t capacity;
+    
+    /// Position of the first free byte
+    int64_t offset;
+    
+    /// Maximal position reached
+    int64_t maxOffset;
+    
+    /// Number of \c ScratchArenaScope open on the arena
+    int nOpenScopes;
+    
+  public:
+    
+    /// Creates the arena, without allocating the buffer
+    ScratchArena() :
+      buffer(nullptr),
+      capacity(0),
+      offset(0),
+      maxOffset(0),
+      nOpenScopes(0)
+    {
+    }
+    
+    /// Frees the buffer
+    ~ScratchArena()
+    {
+      free(buffer);
+    }
+    
+    /// Forbids copying the arena
+    ScratchArena(const ScratchArena&)=delete;
+    
+    /// Provides memory for \c nel elements of type \c T, or null if no scope is open or there is no room
+    ///
+    /// The memory is valid until the innermost enclosing
+    /// \c ScratchArenaScope is closed or rewound
+    template <typename T>
+    T* tryProvide(const int64_t nel,
+		  const int64_t alignment=CACHE_LINE_SIZE)
+    {
+      if(nOpenScopes==0)
+	return nullptr;
+      
+      if(buffer==nullptr)
+	{
+	  capacity=
+	    scratchArenaSize;
+	  
+	  if(posix_memalign((void**)&buffer,CACHE_LINE_SIZE,capacity))
+	    CRASHER<<"Failed to allocate a scratch arena of "<<capacity<<" bytes"<<endl;
+	}
+      
+      /// Beginning of the provided memory
+      const int64_t beg=
+	(offset+alignment-1)/alignment*alignment;
+      
+      /// End of the provided memory
+      const int64_t end=
+	beg+(int64_t)sizeof(T)*nel;
+      
+      if(end>capacity)
+	return nullptr;
+      
+      offset=end;
+      maxOffset=std::max(maxOffset,offset);
+      
+      return
+	reinterpret_cast<T*>(buffer+beg);
+    }
+    
+    /// Check whether the memory pointed by \a ptr has been provided by the arena
+    bool contains(const void* ptr)
+      const
+    {
+      return
+	buffer!=nullptr and ptr>=buffer and ptr<buffer+capacity;
+    }
+    
+    /// Position of the first free byte
+    int64_t getOffset()
+      const
+    {
+      return
+	offset;
+    }
+    
+    /// Maximal amount of memory used so far
+    int64_t getMaxOffset()
+      const
+    {
+      return
+	maxOffset;
+    }
+    
+    /// Gives back all the memory provided after the given position
+    void rewind(const int64_t& pos)
+    {
+      offset=
+	pos;
+    }
+    
+    /// Takes note of the opening of a scope
+    void openScope()
+    {
+      nOpenScopes++;
+    }
+    
+    /// Takes note of the closing of a scope
+    void closeScope()
+    {
+      nOpenScopes--;
+    }
+  };
+  
+  namespace resources
+  {
+    /// Arena of the thread
+    EXTERN_SCRATCH_ARENA thread_local ScratchArena scratchArena;
+  }
+  
+  /// Returns the arena of the calling thread
+  inline ScratchArena& scratchArena()
+  {
+    return
+      resources::scratchArena;
+  }
+  
+  /// Lets the arena of the thread provide memory, given back when the scope is closed
+  ///
+  /// Outside any scope the arena provides no memory. \c loopSplit
+  /// opens a scope in each thread, rewinding it after each
+  /// iteration. Scopes can be nested.
+  class ScratchArenaScope
+  {
+    /// Arena of the thread opening the scope
+    ScratchArena& arena;
+    
+    /// Position of the arena at the opening of the scope
+    const int64_t offset;
+    
+  public:
+    
+    /// Opens the scope on the arena of the calling thread
+    ScratchArenaScope() :
+      arena(scratchArena()),
+      offset(arena.getOffset())
+    {
+      arena.openScope();
+    }
+    
+    /// Gives back the memory provided since the opening, leaving the scope open
+    INLINE_FUNCTION
+    void rewind()
+    {
+      arena.rewind(offset);
+    }
+    
+    /// Closes the scope, giving back the memory
+    ~ScratchArenaScope()
+    {
+      rewind();
+      arena.closeScope();
+    }
+    
+    /// Forbids copying the scope
+    ScratchArenaScope(const ScratchArenaScope&)=delete;
+  };
+  
+  class ArenaScope;
+  
+  namespace resources
+  {
+    /// Innermost \c ArenaScope open in the thread, null if none
+    EXTERN_SCRATCH_ARENA thread_local ArenaScope* arenaScope;
+  }
+  
+  /// Scope of the arena of the thread, collecting statistics of the temporaries taken from it
+  ///
+  /// To be opened around a kernel, or each iteration of it, creating
+  /// temporaries, such as the tensors returned by \c close. As any
+  /// \c ScratchArenaScope, it lets the tensors which might go on the
+  /// arena take their storage from it, giving it back all at once
+  /// when closed, while other tensors keep using the memory
+  /// manager. When the arena has no room left, storage is provided by
+  /// the memory manager as usual. If the scope is given a name, the
+  /// number of allocations served by the arena is accumulated in
+  /// statistics printed by \c printArenaScopeStatistics.
+  class ArenaScope
+  {
+    /// Scope giving back the memory of the arena
+    ScratchArenaScope scratchScope;
+    
+    /// Scope enclosing this one
+    ArenaScope* const outer;
+    
+    /// Name used to collect statistics, if not null
+    const char* const name;
+    
+    /// Number of allocations served by the arena
+    int64_t nProvides;
+    
+    /// Size of memory served by the arena
+    int64_t providedSize;
+    
+    /// Accumulate the statistics of the scope
+    void accountStatistics();
+    
+  public:
+    
+    /// Opens the scope in the calling thread
+    ArenaScope(const char* name=nullptr) :
+      outer(resources::arenaScope),
+      name(name),
+      nProvides(0),
+      providedSize(0)
+    {
+      resources::arenaScope=this;
+    }
+    
+    /// Closes the scope, giving back the memory
+    ///
+    /// If works possibly using the memory have been dispatched to the
+    /// pool, waits for their completion
+    ~ArenaScope();
+    
+    /// Forbids copying the scope
+    ArenaScope(const ArenaScope&)=delete;
+    
+    /// Takes note of memory served by the arena
+    void accountProvide(const int64_t& size)
+    {
+      nProvides++;
+      providedSize+=size;
+    }
+    
+    /// Number of allocations served by the arena, including the inner scopes already closed
+    int64_t getNProvides()
+      const
+    {
+      return
+	nProvides;
+    }
+  };
+  
+  /// Provides memory for \c nel elements of type \c T of a temporary from the arena of the thread
+  ///
+  /// Returns null if no scope is open or the arena has no room. The
+  /// memory is accounted to the innermost \c ArenaScope open in the
+  /// thread, if any.
+  template <typename T>
+  T* provideTemporaryFromArena(const int64_t nel)
+  {
+    /// Result
+    T* ptr=
+      scratchArena().template tryProvide<T>(nel);
+    
+    if(ptr and resources::arenaScope)
+      resources::arenaScope->accountProvide(sizeof(T)*nel);
+    
+    return
+      ptr;
+  }
+  
+  /// Prints the allocations served by the named \c ArenaScope, summed over all threads
+  void printArenaScopeStatistics();
+}
+
+#undef EXTERN_SCRATCH_ARENA
+
+#endif
@@ -47,6 +47,8 @@ namespace ciccios
     cpuMemoryManager=new CPUMemoryManager;
     //cpuMemoryManager->disableCache();
     
+    fileMemoryManager=new FileMemoryManager;
+    
     initCuda();
     
 #ifdef USE_CUDA
@@ -61,9 +63,17 @@ namespace ciccios
   {
     ThreadPool::poolStop();
     
+    if(memoryReportFile!="")
+      cpuMemoryManager->writeReport(memoryReportFile+".cpu."+std::to_string(rank()));
+    
     delete cpuMemoryManager;
     
+    delete fileMemoryManager;
+    
 #ifdef USE_CUDA
+    if(memoryReportFile!="")
+      gpuMemoryManager->writeReport(memoryReportFile+".gpu."+std::to_string(rank()));
+    
     delete gpuMemoryManager;
 #endif
     
@@ -88,6 +88,59 @@ namespace ciccios
     ArithmeticArray<Fund,simdLength<Fund>>
 #endif
     ;
+  
+  /// Fundamental type of a Simd, or the type itself if not a Simd
+  template <typename T>
+  struct FundOfSimd
+  {
+    /// Type is not a Simd
+    static constexpr bool isSimd=
+      false;
+    
+    /// Fundamental type
+    using type=
+      T;
+  };
+  
+  /// Provides the fundamental type of the Simd of FUND
+#define PROVIDE_FUND_OF_SIMD(FUND)		\
+  /*! Simd of FUND */				\
+  template <>					\
+  struct FundOfSimd<Simd<FUND>>			\
+  {						\
+    /*! Type is a Simd */			\
+    static constexpr bool isSimd=		\
+      true;					\
+						\
+    /*! Fundamental type */			\
+    using type=					\
+      FUND;					\
+  }
+  
+  PROVIDE_FUND_OF_SIMD(float);
+  PROVIDE_FUND_OF_SIMD(double);
+  
+#undef PROVIDE_FUND_OF_SIMD
+  
+  /// Reduce the lanes of a Simd with the given binary operation
+  template <typename Fund,
+	    typename C>
+  Fund simdHorizontalReduce(const Simd<Fund>& s, ///< Simd to reduce
+			    C&& combine)         ///< Binary operation
+  {
+    /// Lanes of the Simd
+    Fund lanes[simdLength<Fund>];
+    memcpy(lanes,&s,sizeof(Simd<Fund>));
+    
+    /// Result
+    Fund res=
+      lanes[0];
+    
+    for(int iLane=1;iLane<simdLength<Fund>;iLane++)
+      res=combine(res,lanes[iLane]);
+    
+    return res;
+  }
 }
 
 #endif
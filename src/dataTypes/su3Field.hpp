@@ -5,11 +5,18 @@
 ///
 /// \brief CPU, GPU and SIMD implementation, with GPU or CPU storage
 ///
+/// CPU and SIMD fields can be stored on file, to open saved fields
+/// without copying them, and to handle ensembles larger than the
+/// memory. Loops over these fields advise the kernel about the
+/// memory accessed by each thread.
+///
 /// \todo Make a Field type more general
 
 #include <type_traits>
 
+#include <base/fileMemoryManager.hpp>
 #include <base/memoryManager.hpp>
+#include <base/metaProgramming.hpp>
 #include <dataTypes/su3.hpp>
 
 namespace ciccios
@@ -180,7 +187,7 @@ namespace ciccios
     INLINE_FUNCTION
     void sitesLoop(F&& f) const
     {
-      ThreadPool::loopSplit(0,vol,std::forward<F>(f));
+      ThreadPool::loopSplit(0,vol,std::forward<F>(f),loopScheduleOn<SL>(data,sizeof(Fund)*index(1,0,0,0)));
     }
   };
   
@@ -235,6 +242,10 @@ namespace ciccios
     using BaseType=
       Fund;
     
+    /// Location of the data: on file if asked, otherwise in the host memory
+    static constexpr StorLoc hostStorLoc=
+      (SL==StorLoc::ON_FILE)?StorLoc::ON_FILE:StorLoc::ON_CPU;
+    
     /// Volume
     const int fusedVol;
     
@@ -286,7 +297,7 @@ namespace ciccios
       /// Compute the size
       const int size=index(fusedVol,0,0,0);
       
-      data=cpuMemoryManager->template provide<Simd<Fund>>(size);
+      data=memoryManager<hostStorLoc>()->template provide<Simd<Fund>>(size);
     }
     
     /// Copy constructor
@@ -301,7 +312,7 @@ namespace ciccios
     {
 #ifndef COMPILING_FOR_DEVICE
       if(not isRef)
-	cpuMemoryManager->release(data);
+	memoryManager<hostStorLoc>()->release(data);
 #endif
     }
     
@@ -323,7 +334,7 @@ namespace ciccios
     INLINE_FUNCTION
     void sitesLoop(F&& f) const
     {
-      ThreadPool::loopSplit(0,fusedVol,std::forward<F>(f));
+      ThreadPool::loopSplit(0,fusedVol,std::forward<F>(f),loopScheduleOn<hostStorLoc>(data,sizeof(Simd<Fund>)*index(1,0,0,0)));
     }
   };
   
@@ -352,6 +363,15 @@ namespace ciccios
       }
     };
     
+    /// Instantiate the proper loop splitter
+    ///
+    /// File case, the loop runs on the host
+    template <>
+    struct GpuSitesLooper<StorLoc::ON_FILE> :
+      GpuSitesLooper<StorLoc::ON_CPU>
+    {
+    };
+    
     /// Instantiate the proper loop splitter
     ///
     /// GPU case
@@ -501,8 +521,11 @@ namespace ciccios
   {
     /// Assign from a non-simd version
     template <typename F,
-	      typename OF>
-    SimdSU3Field<F,StorLoc::ON_CPU>& deepCopy(SimdSU3Field<F,StorLoc::ON_CPU>& res,const CpuSU3Field<OF,StorLoc::ON_CPU>& oth)
+	      StorLoc SL,
+	      typename OF,
+	      StorLoc OSL,
+	      ENABLE_THIS_TEMPLATE_IF(isOnHost<SL> and isOnHost<OSL>)>
+    SimdSU3Field<F,SL>& deepCopy(SimdSU3Field<F,SL>& res,const CpuSU3Field<OF,OSL>& oth)
     {
       for(int iSite=0;iSite<res.fusedVol*simdLength<F>;iSite++)
     	{
@@ -523,8 +546,11 @@ namespace ciccios
     
     /// Assign from a non-simd version
     template <typename F,
-	      typename OF>
-    CpuSU3Field<F,StorLoc::ON_CPU>& deepCopy(CpuSU3Field<F,StorLoc::ON_CPU>& res,const CpuSU3Field<OF,StorLoc::ON_CPU>& oth)
+	      StorLoc SL,
+	      typename OF,
+	      StorLoc OSL,
+	      ENABLE_THIS_TEMPLATE_IF(isOnHost<SL> and isOnHost<OSL>)>
+    CpuSU3Field<F,SL>& deepCopy(CpuSU3Field<F,SL>& res,const CpuSU3Field<OF,OSL>& oth)
     {
       for(int iSite=0;iSite<res.vol;iSite++)
     	{
@@ -539,8 +565,11 @@ namespace ciccios
     
     /// Assign from SIMD version, with possible different type
     template <typename F,
-	      typename OF>
-    auto& deepCopy(CpuSU3Field<F,StorLoc::ON_CPU>& res,const SimdSU3Field<OF,StorLoc::ON_CPU>& oth)
+	      StorLoc SL,
+	      typename OF,
+	      StorLoc OSL,
+	      ENABLE_THIS_TEMPLATE_IF(isOnHost<SL> and isOnHost<OSL>)>
+    auto& deepCopy(CpuSU3Field<F,SL>& res,const SimdSU3Field<OF,OSL>& oth)
     {
       for(int iFusedSite=0;iFusedSite<oth.fusedVol;iFusedSite++)
 	for(int ic1=0;ic1<NCOL;ic1++)
@@ -31,7 +31,20 @@ namespace ciccios
     /// Assign to an expression
     template <typename U>
     INLINE_FUNCTION constexpr CUDA_HOST_DEVICE
-    const U& operator=(const Expr<U>& u)
+    const T& operator=(const Expr<U>& u)
+    {
+      assign(*this,u.deFeat(),(typename T::Comps*)nullptr);
+      
+      return
+	this->deFeat();
+    }
+    
+    /// Assign to an expression of the same type
+    ///
+    /// The implicit copy assignment would be otherwise preferred to
+    /// the template, doing nothing
+    INLINE_FUNCTION constexpr CUDA_HOST_DEVICE
+    const T& operator=(const Expr& u)
     {
       assign(*this,u.deFeat(),(typename T::Comps*)nullptr);
       
@@ -47,14 +60,16 @@ namespace ciccios
     
     /// Closes the expression
     ///
-    /// Returns a tensor with the components of the expression
+    /// Returns a temporary tensor with the components of the
+    /// expression, taken from the scratch arena if too large for the
+    /// stack
     /// \todo Dynamic case to be implemented
     INLINE_FUNCTION constexpr CUDA_HOST_DEVICE
     auto _close(TO_TENS)
       const
     {
       /// Result to be returned
-      Tens<typename T::Comps,typename T::Fund> a;
+      TensTemp<typename T::Comps,typename T::Fund> a;
       
       a=
 	this->deFeat();
@@ -17,18 +17,19 @@ namespace ciccios
 {
   /// Short name for the field
 #define THIS					\
-  Field<SPComp,TC,F,SL,FL>
+  Field<SPComp,TC,F,SL,FL,IsStackable>
   
   /// Field tensor provider
 #define FTP					\
-  FieldTensProvider<SPComp,TC,F,SL,FL>
+  FieldTensProvider<SPComp,TC,F,SL,FL,IsStackable>
   
   /// Field
   template <typename SPComp,
 	    typename TC,
 	    typename F,
 	    StorLoc SL,
-	    FieldLayout FL>
+	    FieldLayout FL,
+	    Stackable IsStackable>
   struct Field : public
   FieldFeat<IsField,THIS>,
     FTP,
@@ -44,6 +45,24 @@ namespace ciccios
     {
     }
     
+    /// Copy constructor, copying the data, or sharing it if copy-on-write
+    ///
+    /// Explicit, so that the field can be returned or stored in
+    /// containers only through the move constructor
+    explicit Field(const Field& oth) :
+      FTP(oth.t.template copy<typename FTP::T>())
+    {
+    }
+    
+    /// Move constructor, taking the data of \c oth
+    Field(Field&& oth)=default;
+    
+    /// Copy assignment, copying the values
+    Field& operator=(const Field& oth)=default;
+    
+    /// Move assignment, exchanging the data with \c oth
+    Field& operator=(Field&& oth)=default;
+    
     /// Determine whether this can be simdfified
     static constexpr bool canBeSimdified=
       FTP::T::canBeSimdified;
@@ -59,9 +78,10 @@ namespace ciccios
     
     /// Copy from a non-SIMD layout to a SIMD layout
     template <typename OF,
+	      Stackable OIS,
 	      FieldLayout TFL=FL,
 	      ENABLE_THIS_TEMPLATE_IF(TFL==FieldLayout::SIMD_LAYOUT)>
-    Field& operator=(const Field<SPComp,TC,OF,SL,FieldLayout::CPU_LAYOUT>& oth)
+    Field& operator=(const Field<SPComp,TC,OF,SL,FieldLayout::CPU_LAYOUT,OIS>& oth)
     {
       /// Get volume
       const SPComp& fieldVol=
@@ -89,9 +109,10 @@ namespace ciccios
     
     /// Copy from a SIMD layout to a non-SIMD layout
     template <typename OF,
+	      Stackable OIS,
 	      FieldLayout TFL=FL,
 	      ENABLE_THIS_TEMPLATE_IF(TFL==FieldLayout::CPU_LAYOUT)>
-    Field& operator=(const Field<SPComp,TC,OF,SL,FieldLayout::SIMD_LAYOUT>& oth)
+    Field& operator=(const Field<SPComp,TC,OF,SL,FieldLayout::SIMD_LAYOUT,OIS>& oth)
     {
       /// Get volume
       const SPComp& fieldVol=
@@ -119,9 +140,10 @@ namespace ciccios
     
     /// Create SIMD from non-SIMD
     template <typename OF,
+	      Stackable OIS,
 	      FieldLayout TFL=FL,
 	      ENABLE_THIS_TEMPLATE_IF(TFL==FieldLayout::SIMD_LAYOUT)>
-    explicit Field(const Field<SPComp,TC,OF,SL,FieldLayout::CPU_LAYOUT>& oth) :
+    explicit Field(const Field<SPComp,TC,OF,SL,FieldLayout::CPU_LAYOUT,OIS>& oth) :
       Field(oth.template compSize<SPComp>())
     {
       (*this)=
@@ -130,10 +152,11 @@ namespace ciccios
     
     /// Create non-SIMD from SIMD
     template <typename OF,
+	      Stackable OIS,
 	      FieldLayout TFL=FL,
 	      typename OFT=FieldTraits<SPComp,TC,OF,FieldLayout::SIMD_LAYOUT>,
 	      ENABLE_THIS_TEMPLATE_IF(TFL==FieldLayout::CPU_LAYOUT)>
-    explicit Field(const Field<SPComp,TC,OF,SL,FieldLayout::SIMD_LAYOUT>& oth) :
+    explicit Field(const Field<SPComp,TC,OF,SL,FieldLayout::SIMD_LAYOUT,OIS>& oth) :
       Field((SPComp)(oth.template compSize<typename OFT::FusedSPComp>()*
 		     oth.template compSize<typename OFT::UnFusedSPComp>()))
     {
@@ -33,11 +33,15 @@ namespace ciccios
   DEFINE_FEATURE_GROUP(FieldFeat);
   
   /// Field: a tensor with spacetime type
+  ///
+  /// The data is taken from the memory manager, unless asked to be
+  /// shared by copy-on-write among the copies of the field
   template <typename SPComp,
 	    typename TC,
 	    typename F=double,
 	    StorLoc SL=DefaultStorage,
-	    FieldLayout FL=DefaultFieldLayout>
+	    FieldLayout FL=DefaultFieldLayout,
+	    Stackable IsStackable=Stackable::CANNOT_GO_ON_STACK>
   struct Field;
 }
 
@@ -19,7 +19,8 @@ namespace ciccios
 	    typename TC,
 	    typename F,
 	    StorLoc SL,
-	    FieldLayout FL>
+	    FieldLayout FL,
+	    Stackable IsStackable>
   struct FieldTensProvider
   {
     /// Field traits
@@ -32,7 +33,7 @@ namespace ciccios
     
     /// Tensor type
     using T=
-      Tens<Comps,F,SL,Stackable::CANNOT_GO_ON_STACK>;
+      Tens<Comps,F,SL,IsStackable>;
     
     /// Tensor
     T t;
@@ -63,6 +64,12 @@ namespace ciccios
       t(FT::adaptSpaceTime(spaceTime.deFeat()),dynCompSize.dFeat()...)
     {
     }
+    
+    /// Create taking the ownership of the tensor
+    FieldTensProvider(T&& t) :
+      t(std::move(t))
+    {
+    }
   };
 }
 
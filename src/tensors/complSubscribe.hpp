@@ -39,7 +39,7 @@ namespace ciccios
     PROVIDE_RE_OR_IM_CONST_OR_NOT(REAL_OR_IMAG,RE_OR_IM,const)		\
     
     PROVIDE_RE_OR_IM_CONST_AND_NOT(real,RE)
-    PROVIDE_RE_OR_IM_CONST_AND_NOT(imag,RE)
+    PROVIDE_RE_OR_IM_CONST_AND_NOT(imag,IM)
     
 #undef PROVIDE_RE_OR_IM_CONST_AND_NOT
 #undef PROVIDE_RE_OR_IM_CONST_OR_NOT
@@ -1,14 +1,23 @@
 #ifndef _STORAGE_HPP
 #define _STORAGE_HPP
 
+#include <base/copyOnWrite.hpp>
+#include <base/fileMemoryManager.hpp>
 #include <base/memoryManager.hpp>
 #include <base/metaProgramming.hpp>
+#include <base/scratchArena.hpp>
 #include <tensors/componentSize.hpp>
 
 namespace ciccios
 {
   /// Stackability
-  enum class Stackable{CANNOT_GO_ON_STACK,MIGHT_GO_ON_STACK};
+  ///
+  /// If the data does not go on the stack, it is taken from the
+  /// memory manager, or from the scratch arena of the thread. A
+  /// \c VIEW does not own any data, and refers to the data owned by
+  /// another tensor. Data \c COPY_ON_WRITE is shared with the copies
+  /// of the tensor, each page being duplicated when first written.
+  enum class Stackable{CANNOT_GO_ON_STACK,MIGHT_GO_ON_STACK,MIGHT_GO_ON_STACK_ELSE_ON_ARENA,VIEW,COPY_ON_WRITE};
   
   /// Basic storage, to use to detect storage
   template <typename T>
@@ -25,17 +34,32 @@ namespace ciccios
 	    Stackable::MIGHT_GO_ON_STACK>
   struct TensStorage
   {
+    /// Provides the data from the scratch arena of the thread, if the storage might go on it
+    ///
+    /// Returns null if the storage cannot go on the arena, if no
+    /// \c ScratchArenaScope is open, or if the arena has no room
+    static Fund* tryProvideFromArena(const Size& dynSize)
+    {
+      if(IsStackable!=Stackable::MIGHT_GO_ON_STACK_ELSE_ON_ARENA or SL!=StorLoc::ON_CPU)
+	return nullptr;
+      
+      return
+	provideTemporaryFromArena<Fund>(dynSize);
+    }
+    
     /// Structure to hold dynamically allocated data
+    ///
+    /// The data is owned, so the storage can be moved but not copied
     struct DynamicStorage
     {
-      /// Hold info if it is a reference
-      const bool isRef;
+      /// Hold info if the data is taken from the arena, and must not be released
+      bool isRef;
       
       /// Storage
       Fund* data;
       
       /// Allocated size
-      const Size dynSize;
+      Size dynSize;
       
       /// Returns the size
       constexpr Size getSize()
@@ -55,45 +79,71 @@ namespace ciccios
       
       PROVIDE_ALSO_NON_CONST_METHOD_GPU(getDataPtr);
       
-      /// Construct allocating data
-      DynamicStorage(const Size& dynSize) :
-	isRef(false),
-	data(memoryManager<SL>()->template provide<Fund>(dynSize)),
-	dynSize(dynSize)
+      /// Provides the data from the memory manager, attributing it to the label, if not null
+      ///
+      /// The label of a \c MemoryLabelScope opened by the user takes
+      /// precedence
+      static Fund* provideLabelled(const Size& dynSize,
+				   const char* label)
       {
+	/// Scope attributing the allocation
+	MemoryLabelScope labelScope(resources::memoryLabel?resources::memoryLabel:label);
+	
+	return
+	  memoryManager<SL>()->template provide<Fund>(dynSize);
       }
       
-      /// "Copy" constructor, actually taking a reference
-      CUDA_HOST_DEVICE
-      DynamicStorage(const DynamicStorage& oth) :
-	isRef(true),
-	dynSize(oth.dynSize),
-	data(oth.data)
+      /// Tag to select the allocation of data when the passed pointer is null
+      struct AllocateIfNull{};
+      
+      /// Construct taking the data from the arena, if not null, or from the memory manager
+      DynamicStorage(Fund* arenaData,
+		     const Size& dynSize,
+		     AllocateIfNull,
+		     const char* label) :
+	isRef(arenaData!=nullptr),
+	data(arenaData?arenaData:provideLabelled(dynSize,label)),
+	dynSize(dynSize)
       {
       }
       
-      /// Create a reference starting from a pointer
-      CUDA_HOST_DEVICE
-      DynamicStorage(Fund* oth,
-		     const Size& dynSize) :
-	isRef(true),
-	data(oth),
-	dynSize(dynSize)
+      /// Construct allocating data, attributed to the label if memory is tracked
+      ///
+      /// Data taken from the arena is not released at destruction,
+      /// but when the enclosing \c ScratchArenaScope is closed
+      DynamicStorage(const Size& dynSize,
+		     const char* label=nullptr) :
+	DynamicStorage(tryProvideFromArena(dynSize),dynSize,AllocateIfNull{},label)
       {
       }
       
-      /// Move constructor
+      /// Forbids copying, the data cannot be owned twice
+      DynamicStorage(const DynamicStorage&)=delete;
+      
+      /// Move constructor, taking the ownership of the data
       CUDA_HOST_DEVICE
-      DynamicStorage(DynamicStorage&& oth) :
+      DynamicStorage(DynamicStorage&& oth) noexcept :
 	isRef(oth.isRef),
-	dynSize(oth.dynSize),
-	data(oth.data)
+	data(oth.data),
+	dynSize(oth.dynSize)
       {
 	oth.isRef=true;
 	oth.data=nullptr;
 	oth.dynSize=0;
       }
       
+      /// Move assignment, exchanging the data with the source, which releases it
+      CUDA_HOST_DEVICE
+      DynamicStorage& operator=(DynamicStorage&& oth) noexcept
+      {
+	std::swap(isRef,oth.isRef);
+	std::swap(data,oth.data);
+	std::swap(dynSize,oth.dynSize);
+	
+	return
+	  *this;
+      }
+      
 #ifndef COMPILING_FOR_DEVICE
       /// Destructor deallocating the memory
       ~DynamicStorage()
@@ -104,6 +154,84 @@ namespace ciccios
 #endif
     };
     
+    /// Structure referring to data owned by someone else
+    ///
+    /// Copying the view gives another view on the same data
+    struct ViewStorage
+    {
+      /// Storage
+      Fund* data;
+      
+      /// Size of the data
+      Size dynSize;
+      
+      /// Returns the size
+      constexpr Size getSize()
+	const
+      {
+	return
+	  dynSize;
+      }
+      
+      /// Returns the pointer to data
+      CUDA_HOST_DEVICE
+      decltype(auto) getDataPtr() const
+      {
+	return
+	  data;
+      }
+      
+      PROVIDE_ALSO_NON_CONST_METHOD_GPU(getDataPtr);
+      
+      /// Create starting from a pointer
+      CUDA_HOST_DEVICE
+      ViewStorage(Fund* oth,
+		  const Size& dynSize) :
+	data(oth),
+	dynSize(dynSize)
+      {
+      }
+    };
+    
+    /// Structure to hold data shared by copy-on-write with the copies
+    ///
+    /// Copying the storage does not copy the data, which is
+    /// duplicated page by page when written by any of the copies
+    struct CopyOnWriteStorage
+    {
+      /// Mapping of the data
+      CopyOnWriteMapping mapping;
+      
+      /// Allocated size
+      Size dynSize;
+      
+      /// Returns the size
+      constexpr Size getSize()
+	const
+      {
+	return
+	  dynSize;
+      }
+      
+      /// Returns the pointer to data
+      decltype(auto) getDataPtr() const
+      {
+	return
+	  static_cast<Fund*>(mapping.getPtr());
+      }
+      
+      PROVIDE_ALSO_NON_CONST_METHOD(getDataPtr);
+      
+      /// Construct mapping new data
+      CopyOnWriteStorage(const Size& dynSize=StaticSize,
+			 const char* /*label*/=nullptr) :
+	mapping(sizeof(Fund)*dynSize),
+	dynSize(dynSize)
+      {
+	static_assert(SL==StorLoc::ON_CPU,"Copy-on-write is only available on CPU");
+      }
+    };
+    
     /// Structure to hold statically allocated data
     struct StackStorage
     {
@@ -131,7 +259,8 @@ namespace ciccios
       
       /// Constructor: since the data is statically allocated, we need to do nothing
       CUDA_HOST_DEVICE
-      StackStorage(const Size& size=0)
+      StackStorage(const Size& size=0,
+		   const char* /*label*/=nullptr)
       {
       }
       
@@ -139,7 +268,7 @@ namespace ciccios
       CUDA_HOST_DEVICE
       StackStorage(const StackStorage& oth)
       {
-	memcpy(this->data,oth.data,StaticSize);
+	memcpy(this->data,oth.data,sizeof(Fund)*StaticSize);
       }
       
       // /// Move constructor is deleted
@@ -151,18 +280,38 @@ namespace ciccios
     static constexpr
     Size MAX_STACK_SIZE=2304;
     
+    /// Determine whether the data is owned by someone else
+    static constexpr
+    bool isView=
+      (IsStackable==Stackable::VIEW);
+    
+    /// Determine whether the data is shared by copy-on-write
+    static constexpr
+    bool isCopyOnWrite=
+      (IsStackable==Stackable::COPY_ON_WRITE);
+    
     /// Decide whether to allocate on the stack or dynamically
     static constexpr
     bool stackAllocated=
       (StaticSize!=DYNAMIC) and
-      (IsStackable==Stackable::MIGHT_GO_ON_STACK) and
+      (IsStackable!=Stackable::CANNOT_GO_ON_STACK) and
+      (not isView) and
+      (not isCopyOnWrite) and
       (StaticSize*sizeof(Fund)<=MAX_STACK_SIZE) and
       ((CompilingForDevice==true  and SL==StorLoc::ON_GPU) or
        (CompilingForDevice==false and SL==StorLoc::ON_CPU));
     
+    /// Determine whether the data is held through a pointer which can be exchanged when moving
+    static constexpr
+    bool exchangesDataOnMove=
+      (not stackAllocated) and
+      (not isView);
+    
     /// Actual storage class
     using ActualStorage=
-      std::conditional_t<stackAllocated,StackStorage,DynamicStorage>;
+      std::conditional_t<isView,ViewStorage,
+			 std::conditional_t<isCopyOnWrite,CopyOnWriteStorage,
+					    std::conditional_t<stackAllocated,StackStorage,DynamicStorage>>>;
     
     /// Storage of data
     ActualStorage data;
@@ -185,37 +334,40 @@ namespace ciccios
     }
     
     /// Construct taking the size to allocate
-    TensStorage(const Size& size) ///< Size to allocate
-      : data(size)
+    ///
+    /// The label is used to attribute the allocation when memory is
+    /// tracked, only if taken from the memory manager
+    TensStorage(const Size& size,           ///< Size to allocate
+		const char* label=nullptr)  ///< Label of the allocation
+      : data(size,label)
     {
+      static_assert(not isView,"A view must be created from a pointer");
     }
     
-    /// Creates starting from a reference
+    /// Creates a view starting from a pointer
     CUDA_HOST_DEVICE
     TensStorage(Fund* oth,
 		const Size& size) :
       data(oth,size)
     {
-      static_assert(stackAllocated==false,"Only dynamic allocation is possible when creating a reference");
+      static_assert(isView,"Only a view can be created from a pointer");
     }
     
     /// Construct taking the size to allocate
-    TensStorage()
+    TensStorage() :
+      data(StaticSize)
     {
-      static_assert(stackAllocated,"If not stack allocated must pass the size");
+      static_assert(stackAllocated or ((IsStackable==Stackable::MIGHT_GO_ON_STACK_ELSE_ON_ARENA or isCopyOnWrite) and StaticSize!=DYNAMIC),"If not stack allocated must pass the size");
     }
     
-    /// Copy constructor
-    CUDA_HOST_DEVICE
-    TensStorage(const TensStorage& oth) : data(oth.data)
-    {
-    }
+    /// Copy constructor, deleted if the data is owned through a pointer, unless shared by copy-on-write
+    TensStorage(const TensStorage&)=default;
     
     /// Move constructor
-    CUDA_HOST_DEVICE
-    TensStorage(TensStorage&& oth) : data(std::move(oth.data))
-    {
-    }
+    TensStorage(TensStorage&&)=default;
+    
+    /// Move assignment
+    TensStorage& operator=(TensStorage&&)=default;
     
     /// Access to a sepcific value via subscribe operator
     template <typename T>                  // Subscribed component type
@@ -223,7 +375,7 @@ namespace ciccios
       const
     {
       return
-	data.data[t];
+	data.getDataPtr()[t];
     }
     
     PROVIDE_ALSO_NON_CONST_METHOD(operator[]);
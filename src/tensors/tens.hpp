@@ -9,17 +9,48 @@
 #include <tensors/tensDecl.hpp>
 #include <tensors/complSubscribe.hpp>
 #include <tensors/componentsList.hpp>
+#include <tensors/tensCursor.hpp>
 #include <tensors/tensFeat.hpp>
 #include <tensors/tensSlice.hpp>
 #include <utilities/tuple.hpp>
 
 namespace ciccios
 {
+  namespace impl
+  {
+    /// Determine whether some of the components is followed by a component with size not known at compile time
+    template <typename...TC>
+    constexpr bool someCompHasDynamicStride()
+    {
+      /// Mark the components with size known at compile time, shifted by one
+      constexpr bool isStatic[]=
+	{true,TC::SizeIsKnownAtCompileTime...};
+      
+      /// Result
+      bool res=false;
+      
+      // The first component is followed by no one
+      for(int i=2;i<=(int)sizeof...(TC);i++)
+	res|=not isStatic[i];
+      
+      return
+	res;
+    }
+  }
+  
   /// Short name for the tensor
 #define THIS					\
   Tens<TensComps<TC...>,F,SL,IsStackable>
   
   /// Tensor
+  ///
+  /// Unless it is a \c VIEW, the tensor owns its data. A tensor
+  /// holding its data through a pointer can be moved, passing the
+  /// ownership of the data, but not copied, so that no copy can
+  /// happen unnoticed: the data must be copied explicitly through
+  /// \c copy. Copying a view gives another view on the same data,
+  /// while copying a tensor \c COPY_ON_WRITE shares the data with the
+  /// copy until either is written.
   template <typename F,
 	    StorLoc SL,
 	    typename...TC,
@@ -32,11 +63,14 @@ namespace ciccios
     /// Import assign operator from expression
     using Expr<THIS>::operator=;
     
+    /// Copy assignment, copying the values
+    ///
+    /// The expression assignment is called explicitly, since the
+    /// implicit copy assignment of the base expression would be chosen
     INLINE_FUNCTION CUDA_HOST_DEVICE
     decltype(auto) operator=(const THIS& oth)
     {
-      *this=
-	static_cast<const Expr<THIS>&>(oth);
+      assign(*this,oth,(Comps*)nullptr);
       
       return
 	*this;
@@ -120,7 +154,7 @@ namespace ciccios
       CONST_ATTR							\
     {									\
       return								\
-	Tens<TupleAllButLast<TensComps<TC...>>,Simd<F>,SL,Stackable::CANNOT_GO_ON_STACK> \
+	TensView<TupleAllButLast<TensComps<TC...>>,Simd<F>,SL>		\
 	((Simd<F>*)(this->getDataPtr()),this->data.getSize(),dynamicSizes); \
       }
     
@@ -164,8 +198,9 @@ namespace ciccios
     using DynamicComps=
       TupleFilter<SizeIsKnownAtCompileTime<false>::t,TensComps<TC...>>;
     
-    /// Sizes of the dynamic components
-    const DynamicComps dynamicSizes;
+    /// Sizes of the dynamic components, taking no space if none is present
+    [[ no_unique_address ]]
+    DynamicComps dynamicSizes;
     
     /// Static size
     static constexpr Index staticSize=
@@ -199,61 +234,187 @@ namespace ciccios
 	std::get<Tv>(dynamicSizes);
     }
     
+    /// Position of the component \c C in the list of components
+    template <typename C>
+    static constexpr int compPos()
+    {
+      /// Mark the component C
+      constexpr bool isC[]=
+	{std::is_same<TC,C>::value...};
+      
+      /// Result
+      int pos=0;
+      
+      while(not isC[pos])
+	pos++;
+      
+      return
+	pos;
+    }
+    
+    /// Determine whether all components after \c C have size known at compile time
+    template <typename C>
+    static constexpr bool innerCompsAreStatic()
+    {
+      /// Mark the components with size known at compile time
+      constexpr bool isStatic[]=
+	{TC::SizeIsKnownAtCompileTime...};
+      
+      /// Result
+      bool res=true;
+      
+      for(int i=compPos<C>()+1;i<(int)sizeof...(TC);i++)
+	res&=isStatic[i];
+      
+      return
+	res;
+    }
+    
+    /// Stride of the component \c C, when all components after it have size known at compile time
+    template <typename C>
+    static constexpr Index staticStride()
+    {
+      return
+	productAll<Index>(((compPos<TC>()>compPos<C>()) and TC::SizeIsKnownAtCompileTime?
+			   (Index)TC::Base::sizeAtCompileTime:
+			   Index{1})...);
+    }
+    
+    /// Computes the stride of the component \c C, product of the sizes of all components after it
+    template <typename C>
+    constexpr CUDA_HOST_DEVICE INLINE_FUNCTION
+    Index computeStride()
+      const
+    {
+      return
+	productAll<Index>((compPos<TC>()>compPos<C>()?
+			   (Index)compSize<TC>():
+			   Index{1})...);
+    }
+    
+    /// Determine whether the stride of some component is not known at compile time
+    static constexpr bool hasDynamicStrides=
+      impl::someCompHasDynamicStride<TC...>();
+    
+    /// Empty table of strides, when all of them are known at compile time
+    struct NoStrides
+    {
+    };
+    
+    /// Table of the strides of all components, empty if not needed
+    using Strides=
+      std::conditional_t<hasDynamicStrides,std::array<Index,sizeof...(TC)>,NoStrides>;
+    
+    /// Strides of the components, computed at construction
+    ///
+    /// Only used for the components followed by a component with
+    /// size not known at compile time, taking no space if none is
+    [[ no_unique_address ]]
+    Strides strides;
+    
+    /// Computes the strides of all components
+    ///
+    /// Case in which some stride is not known at compile time
+    template <bool H=hasDynamicStrides,
+	      ENABLE_THIS_TEMPLATE_IF(H)>
+    constexpr CUDA_HOST_DEVICE INLINE_FUNCTION
+    Strides computeStrides()
+      const
+    {
+      return
+	{computeStride<TC>()...};
+    }
+    
+    /// Computes the strides of all components
+    ///
+    /// Case in which all strides are known at compile time
+    template <bool H=hasDynamicStrides,
+	      ENABLE_THIS_TEMPLATE_IF(not H)>
+    constexpr CUDA_HOST_DEVICE INLINE_FUNCTION
+    Strides computeStrides()
+      const
+    {
+      return
+	{};
+    }
+    
+    /// Stride of the component \c C
+    ///
+    /// Case in which the stride is known at compile time
+    template <typename C,
+	      ENABLE_THIS_TEMPLATE_IF(innerCompsAreStatic<C>())>
+    constexpr CUDA_HOST_DEVICE INLINE_FUNCTION
+    Index compStride()
+      const
+    {
+      return
+	staticStride<C>();
+    }
+    
+    /// Stride of the component \c C
+    ///
+    /// Case in which the stride is taken from the table
+    template <typename C,
+	      ENABLE_THIS_TEMPLATE_IF(not innerCompsAreStatic<C>())>
+    constexpr CUDA_HOST_DEVICE INLINE_FUNCTION
+    Index compStride()
+      const
+    {
+      return
+	strides[compPos<C>()];
+    }
+    
     /// Calculate the index - no more components to parse
     constexpr CUDA_HOST_DEVICE INLINE_FUNCTION
-    Index orderedCompsIndex(Index outer) ///< Value of all the outer components
+    Index stridedCompsIndex()
       const
     {
       return
-	outer;
+	0;
     }
     
     /// Calculate index iteratively
     ///
-    /// Given the components (i,j,k) we must compute ((0*ni+i)*nj+j)*nk+k
-    ///
-    /// The parsing of the variadic components is done left to right, so
-    /// to compute the nested bracket list we must proceed inward. Let's
-    /// say we are at component j. We define outer=(0*ni+i) the result
-    /// of inner step. We need to compute thisVal=outer*nj+j and pass it
-    /// to the inner step, which incorporate iteratively all the inner
-    /// components. The first step requires outer=0.
+    /// Given the components (i,j,k) the index is i*si+j*sj+k*sk, each
+    /// stride being a constant or an entry of the table
     template <typename T,
-    	      typename...Tp>
+	      typename...Tp>
     constexpr CUDA_HOST_DEVICE INLINE_FUNCTION
-    Index orderedCompsIndex(Index outer,        ///< Value of all the outer components
-			    T&& thisComp,       ///< Currently parsed component
-			    Tp&&...innerComps)  ///< Inner components
+    Index stridedCompsIndex(const T& thisComp,       ///< Currently parsed component
+			    const Tp&...innerComps)  ///< Inner components
       const
     {
-      /// Remove reference and all attributes to access to types
-      using Tv=
-	std::decay_t<T>;
-      
-      /// Size of this component
-      const auto thisSize=
-	compSize<Tv>();
-      
-      //cout<<"thisSize: "<<thisSize<<endl;
-      /// Value of the index when including this component
-      const auto thisVal=
-	outer*thisSize+thisComp;
-      
       return
-	orderedCompsIndex(thisVal,innerComps...);
+	(Index)thisComp*compStride<T>()+
+	stridedCompsIndex(innerComps...);
     }
     
-    /// Intermediate layer to reorder the passed components
+    /// Calculate the index of the given components
     template <typename...T>
     constexpr CUDA_HOST_DEVICE INLINE_FUNCTION
     Index index(const TensComps<T...>& comps)
       const
     {
-      /// Build the index reordering the components
       return
-	orderedCompsIndex(0,std::get<TC>(comps)...);
+	stridedCompsIndex(std::get<TC>(comps)...);
+    }
+    
+    /// Returns a cursor pointing to the first element
+#define PROVIDE_CURSOR(CONST_ATTR,CONST_AS_BOOL)				\
+    /*! Returns a cursor pointing to the first element, CONST_ATTR case */	\
+    CUDA_HOST_DEVICE INLINE_FUNCTION					\
+    auto cursor()							\
+      CONST_ATTR							\
+    {									\
+      return								\
+	TensCursor<THIS,CONST_AS_BOOL>(const_cast<Fund*>(getDataPtr()),strides); \
     }
     
+    PROVIDE_CURSOR(/* not const */,false);
+    PROVIDE_CURSOR(const,true);
+    
+#undef PROVIDE_CURSOR
+    
     /// Determine whether the components are all static, or not
     static constexpr bool allCompsAreStatic=
       std::is_same<DynamicComps,std::tuple<>>::value;
@@ -287,6 +448,20 @@ namespace ciccios
 	std::string("Tensor<")+NAME_OF_TYPE(Fund)+","+storLocTag<SL>()+">";
     }
     
+    /// Label to which the allocations of the data are attributed when memory is tracked, null otherwise
+    static const char* allocationLabel()
+    {
+      if(not useMemoryTracking)
+	return nullptr;
+      
+      /// Label, including the components, computed at first usage
+      static const std::string label=
+	std::string("Tensor<")+NAME_OF_TYPE(Comps)+","+NAME_OF_TYPE(Fund)+","+storLocTag<SL>()+">";
+      
+      return
+	label.c_str();
+    }
+    
     /// Initialize the dynamical component \t Out using the inputs
     template <typename Ds,   // Type of the dynamically allocated components
 	      typename Out>  // Type to set
@@ -318,7 +493,8 @@ namespace ciccios
 	      ENABLE_THIS_TEMPLATE_IF(sizeof...(TD)>=1)>
     Tens(const TensCompFeat<IsTensComp,TD>&...tdFeat) :
       dynamicSizes{initializeDynSizes((DynamicComps*)nullptr,tdFeat.deFeat()...)},
-      data(staticSize*productAll<Size>(tdFeat.deFeat()...))
+      strides(computeStrides()),
+      data(staticSize*productAll<Size>(tdFeat.deFeat()...),allocationLabel())
     {
     }
     
@@ -327,36 +503,123 @@ namespace ciccios
 	      ENABLE_THIS_TEMPLATE_IF(sizeof...(TD)==0)>
     CUDA_HOST_DEVICE
     Tens() :
-      dynamicSizes{}
+      dynamicSizes{},
+      strides(computeStrides())
     {
     }
     
-    /// Move constructor
-    CUDA_HOST_DEVICE
-    Tens(Tens<TensComps<TC...>,Fund,SL>&& oth) : dynamicSizes(oth.dynamicSizes),data(std::move(oth.data))
+    /// Initialize the tensor with the given dynamic sizes, allocating the given size
+    Tens(const DynamicComps& dynamicSizes,
+	 const Size& size) :
+      dynamicSizes(dynamicSizes),
+      strides(computeStrides()),
+      data(size,allocationLabel())
     {
     }
     
-    /// Copy constructor
+    /// Move constructor, taking the data of \c oth
     CUDA_HOST_DEVICE
-    Tens(const Tens& oth) :
+    Tens(Tens&& oth) noexcept :
       dynamicSizes(oth.dynamicSizes),
-      data(oth.data.getSize())
+      strides(oth.strides),
+      data(std::move(oth.data))
     {
-      static_cast<Expr<Tens>>(*this)=
-	static_cast<const Expr<Tens>&>(oth);
     }
     
-    /// HACK
+    /// Copy constructor
     ///
-    /// \todo Why is a hack?
+    /// Copies the values if the data is on the stack, refers to the
+    /// same data if this is a view, shares it if copy-on-write, and
+    /// is deleted otherwise
+    Tens(const Tens&)=default;
+    
+    /// Creates a view on the data pointed by \c oth
     template <typename...Dyn>
     CUDA_HOST_DEVICE
     Tens(Fund* oth,
 	 const Size& size,
 	 const Dyn&...dynamicSizes) :
-      dynamicSizes(dynamicSizes...),data(oth,size)
+      dynamicSizes(dynamicSizes...),
+      strides(computeStrides()),
+      data(oth,size)
+    {
+    }
+    
+    /// Exchange the data with \c oth, when held through a pointer
+    template <typename S=StorageType,
+	      ENABLE_THIS_TEMPLATE_IF(S::exchangesDataOnMove)>
+    void moveAssign(Tens& oth)
+    {
+      std::swap(dynamicSizes,oth.dynamicSizes);
+      std::swap(strides,oth.strides);
+      
+      data=
+	std::move(oth.data);
+    }
+    
+    /// Copy the values of \c oth, when the data is on the stack or this is a view
+    template <typename S=StorageType,
+	      ENABLE_THIS_TEMPLATE_IF(not S::exchangesDataOnMove)>
+    void moveAssign(Tens& oth)
+    {
+      assign(*this,oth,(Comps*)nullptr);
+    }
+    
+    /// Move assignment
+    ///
+    /// The data is exchanged with \c oth if held through a pointer,
+    /// otherwise the values are copied, so that assigning to a view
+    /// writes the data it refers to
+    INLINE_FUNCTION
+    Tens& operator=(Tens&& oth)
+    {
+      moveAssign(oth);
+      
+      return
+	*this;
+    }
+    
+    /// Returns a tensor sharing the data by copy-on-write
+    template <typename R=Tens,
+	      typename S=StorageType,
+	      ENABLE_THIS_TEMPLATE_IF(S::isCopyOnWrite and std::is_same<R,Tens>::value)>
+    R copy()
+      const
     {
+      return
+	*this;
+    }
+    
+    /// Returns a tensor owning a copy of the data
+    ///
+    /// By default the copy is a temporary, taken from the scratch
+    /// arena if too large for the stack and an arena scope is open,
+    /// from the memory manager otherwise. Any other owning tensor
+    /// type with the same components can be asked.
+    template <typename R=TensTemp<Comps,Fund,SL>,
+	      typename S=StorageType,
+	      ENABLE_THIS_TEMPLATE_IF(not S::isCopyOnWrite)>
+    R copy()
+      const
+    {
+      static_assert(not R::StorageType::isView,"A view cannot own a copy of the data");
+      
+      /// Result, allocated with the same sizes
+      R res(dynamicSizes,data.getSize());
+      
+      /// Size to be copied
+      const Size size=
+	sizeof(Fund)*data.getSize();
+      
+#ifdef USE_CUDA
+      if(SL==StorLoc::ON_GPU)
+	DECRYPT_CUDA_ERROR(cudaMemcpy(res.getDataPtr(),getDataPtr(),size,cudaMemcpyDeviceToDevice),"Copying %ld bytes within gpu",size);
+      else
+#endif
+	memcpy(res.getDataPtr(),getDataPtr(),size);
+      
+      return
+	res;
     }
     
     /// Provide trivial access to the fundamental data
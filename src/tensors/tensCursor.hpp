@@ -0,0 +1,144 @@
+#ifndef _TENS_CURSOR_HPP
+#define _TENS_CURSOR_HPP
+
+/// \file tensCursor.hpp
+///
+/// \brief Implements a cursor moving along the components of a tensor
+///
+/// The cursor holds a pointer to an element and the strides of the
+/// components, so that moving along a component, or accessing an
+/// element at given offsets, costs a multiplication and an addition
+/// to the pointer, instead of the recomputation of the full index.
+/// Strides known at compile time are folded into constants.
+
+#include <base/inliner.hpp>
+#include <base/metaProgramming.hpp>
+#include <tensors/component.hpp>
+
+namespace ciccios
+{
+  /// Cursor pointing to an element of a tensor of type \c T
+  template <typename T,      // Tensor
+	    bool IsConst>    // Const or not
+  struct TensCursor
+  {
+    /// Fundamental type, possibly constant
+    using Fund=
+      ConstIf<IsConst,typename T::Fund>;
+    
+    /// Type to be used for the index
+    using Index=
+      typename T::Index;
+    
+    /// Table of the strides of all components
+    using Strides=
+      typename T::Strides;
+    
+    /// Pointed element
+    Fund* ptr;
+    
+    /// Strides of the components, copied from the tensor, empty if all known at compile time
+    [[ no_unique_address ]]
+    Strides strides;
+    
+    /// Create pointing to \c ptr, with the given strides
+    CUDA_HOST_DEVICE INLINE_FUNCTION
+    TensCursor(Fund* ptr,
+	       const Strides& strides) :
+      ptr(ptr),
+      strides(strides)
+    {
+    }
+    
+    /// Stride of the component \c C
+    ///
+    /// Case in which the stride is known at compile time
+    template <typename C,
+	      ENABLE_THIS_TEMPLATE_IF(T::template innerCompsAreStatic<C>())>
+    constexpr CUDA_HOST_DEVICE INLINE_FUNCTION
+    Index stride()
+      const
+    {
+      return
+	T::template staticStride<C>();
+    }
+    
+    /// Stride of the component \c C
+    ///
+    /// Case in which the stride is taken from the table
+    template <typename C,
+	      ENABLE_THIS_TEMPLATE_IF(not T::template innerCompsAreStatic<C>())>
+    constexpr CUDA_HOST_DEVICE INLINE_FUNCTION
+    Index stride()
+      const
+    {
+      return
+	strides[T::template compPos<C>()];
+    }
+    
+    /// Offset of the pointed element - no more components to parse
+    constexpr CUDA_HOST_DEVICE INLINE_FUNCTION
+    Index offset()
+      const
+    {
+      return
+	0;
+    }
+    
+    /// Offset of the element at the given components from the pointed one
+    template <typename C,
+	      typename...Tail>
+    constexpr CUDA_HOST_DEVICE INLINE_FUNCTION
+    Index offset(const TensCompFeat<IsTensComp,C>& c,
+		 const TensCompFeat<IsTensComp,Tail>&...tail)
+      const
+    {
+      return
+	(Index)c.deFeat()*stride<C>()+
+	offset(tail...);
+    }
+    
+    /// Moves the cursor along the given components
+    template <typename...C>
+    CUDA_HOST_DEVICE INLINE_FUNCTION
+    TensCursor& advance(const TensCompFeat<IsTensComp,C>&...c)
+    {
+      ptr+=
+	offset(c...);
+      
+      return
+	*this;
+    }
+    
+    /// Returns a cursor moved along the given components
+    template <typename...C>
+    CUDA_HOST_DEVICE INLINE_FUNCTION
+    TensCursor moved(const TensCompFeat<IsTensComp,C>&...c)
+      const
+    {
+      return
+	TensCursor(ptr+offset(c...),strides);
+    }
+    
+    /// Access the element at the given components from the pointed one
+    template <typename...C>
+    CUDA_HOST_DEVICE INLINE_FUNCTION
+    Fund& operator()(const TensCompFeat<IsTensComp,C>&...c)
+      const
+    {
+      return
+	ptr[offset(c...)];
+    }
+    
+    /// Access the pointed element
+    CUDA_HOST_DEVICE INLINE_FUNCTION
+    Fund& operator*()
+      const
+    {
+      return
+	*ptr;
+    }
+  };
+}
+
+#endif
@@ -27,6 +27,23 @@ namespace ciccios
 	    StorLoc SL=DefaultStorage,
 	    Stackable IsStackable=Stackable::MIGHT_GO_ON_STACK>
   struct Tens;
+  
+  /// Temporary tensor, taking its data from the scratch arena of the thread if too large for the stack
+  ///
+  /// Must not outlive the innermost \c ScratchArenaScope or
+  /// \c ArenaScope open at its creation
+  template <typename Comps,
+	    typename Fund=double,
+	    StorLoc SL=DefaultStorage>
+  using TensTemp=
+    Tens<Comps,Fund,SL,Stackable::MIGHT_GO_ON_STACK_ELSE_ON_ARENA>;
+  
+  /// Tensor referring to data owned by someone else
+  template <typename Comps,
+	    typename Fund=double,
+	    StorLoc SL=DefaultStorage>
+  using TensView=
+    Tens<Comps,Fund,SL,Stackable::VIEW>;
 }
 
 #endif
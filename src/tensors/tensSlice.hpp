@@ -11,6 +11,7 @@
 #include <tensors/complSubscribe.hpp>
 #include <tensors/component.hpp>
 #include <tensors/componentsList.hpp>
+#include <tensors/tensCursor.hpp>
 #include <tensors/tensDecl.hpp>
 #include <tensors/tensFeat.hpp>
 #include <utilities/tuple.hpp>
@@ -182,6 +183,27 @@ namespace ciccios
     {
     }
     
+    /// Provide a cursor pointing to the first element of the slice
+#define PROVIDE_CURSOR(CONST_ATTR,CONST_AS_BOOL)				\
+    /*! Returns a cursor pointing to the first element, CONST_ATTR case */	\
+    CUDA_HOST_DEVICE INLINE_FUNCTION					\
+    auto cursor()							\
+      CONST_ATTR							\
+    {									\
+      /*! Pointer to the first element */				\
+      auto ptr=								\
+	const_cast<typename T::Fund*>(t.getDataPtr())+			\
+	t.index(fillTuple<typename T::Comps>(subsComps));		\
+									\
+      return								\
+	TensCursor<T,CONST_AS_BOOL or IsConst>(ptr,t.strides);		\
+    }
+    
+    PROVIDE_CURSOR(/* not const */,false);
+    PROVIDE_CURSOR(const,true);
+    
+#undef PROVIDE_CURSOR
+    
     /// Return a tensor pointing to the offsetted data, with the resulting component
     CUDA_HOST_DEVICE INLINE_FUNCTION constexpr
     auto carryOver() const
@@ -202,7 +224,7 @@ namespace ciccios
 	offset;
       
       return
-	Tens<Comps,typename T::Fund,T::storLoc,Stackable::CANNOT_GO_ON_STACK>(carriedData,t.data.getSize());
+	TensView<Comps,typename T::Fund,T::storLoc>(carriedData,t.data.getSize());
     }
   };
   
@@ -0,0 +1,161 @@
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+/// \file affinity.cpp
+///
+/// \brief Implements the pinning of threads
+
+#define EXTERN_AFFINITY
+# include "threads/affinity.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+
+#include <base/debug.hpp>
+#include <base/logger.hpp>
+
+namespace ciccios
+{
+  namespace ThreadPool
+  {
+    /// Returns the cores available to the process, in increasing order
+    std::vector<int> getAvailableCores()
+    {
+      /// Mask of available cores
+      cpu_set_t mask;
+      CPU_ZERO(&mask);
+      
+      if(sched_getaffinity(0,sizeof(cpu_set_t),&mask)!=0)
+	CRASHER<<"Unable to get the affinity mask of the process"<<endl;
+      
+      /// Result
+      std::vector<int> res;
+      
+      for(int iCore=0;iCore<CPU_SETSIZE;iCore++)
+	if(CPU_ISSET(iCore,&mask))
+	  res.push_back(iCore);
+      
+      return res;
+    }
+    
+    /// Gets the socket to which the core belongs, 0 if unknown
+    int getSocketOfCore(const int& iCore)
+    {
+      /// File containing the id of the socket
+      std::ifstream file("/sys/devices/system/cpu/cpu"+std::to_string(iCore)+"/topology/physical_package_id");
+      
+      /// Result
+      int res=0;
+      
+      if(file.good())
+	file>>res;
+      
+      return res;
+    }
+    
+    std::vector<int> getCoresForThreads()
+    {
+      /// Cores available to the process
+      const std::vector<int> availableCores=
+	getAvailableCores();
+      
+      if(threadAffinity=="" or threadAffinity=="none")
+	return {};
+      
+      if(threadAffinity=="compact")
+	return availableCores;
+      
+      if(threadAffinity=="scatter")
+	{
+	  /// Cores grouped per socket
+	  std::map<int,std::vector<int>> coresOfSocket;
+	  for(const int& iCore : availableCores)
+	    coresOfSocket[getSocketOfCore(iCore)].push_back(iCore);
+	  
+	  /// Result
+	  std::vector<int> res;
+	  
+	  // Take in turn one core from each socket
+	  for(size_t iCoreInSocket=0;res.size()<availableCores.size();iCoreInSocket++)
+	    for(const auto& socket : coresOfSocket)
+	      if(iCoreInSocket<socket.second.size())
+		res.push_back(socket.second[iCoreInSocket]);
+	  
+	  return res;
+	}
+      
+      /// Explicit list of cores
+      std::vector<int> res;
+      
+      /// Stream to parse the list
+      std::istringstream is(threadAffinity);
+      
+      /// Each element of the list
+      std::string token;
+      
+      while(std::getline(is,token,','))
+	{
+	  /// Core parsed from the token
+	  int iCore;
+	  
+	  /// Stream used to parse the core
+	  std::istringstream coreStream(token);
+	  
+	  if(not (coreStream>>iCore) or std::find(availableCores.begin(),availableCores.end(),iCore)==availableCores.end())
+	    CRASHER<<"Unable to use core \""<<token<<"\" of the THREAD_AFFINITY list \""<<threadAffinity<<"\""<<endl;
+	  
+	  res.push_back(iCore);
+	}
+      
+      return res;
+    }
+    
+    void setupAffinity(const int& nThreads)
+    {
+      /// Cores to be used
+      const std::vector<int>& cores=
+	resources::coresOfThreads=
+	getCoresForThreads();
+      
+      if(cores.size())
+	{
+	  LOGGER<<"Thread affinity \""<<threadAffinity<<"\":";
+	  for(int threadId=0;threadId<nThreads;threadId++)
+	    LOGGER<<" "<<threadId<<"->"<<cores[threadId%cores.size()];
+	  LOGGER<<endl;
+	  
+	  if((int)cores.size()<nThreads)
+	    LOGGER<<"Warning, "<<nThreads<<" threads pinned on "<<cores.size()<<" cores"<<endl;
+	}
+      else
+	LOGGER<<"Threads not pinned"<<endl;
+    }
+    
+    void pinThread(const int& threadId)
+    {
+      /// Cores to be used
+      const std::vector<int>& cores=
+	resources::coresOfThreads;
+      
+      if(cores.size())
+	{
+	  /// Core to be used
+	  const int iCore=
+	    cores[threadId%cores.size()];
+	  
+	  /// Mask containing only the chosen core
+	  cpu_set_t mask;
+	  CPU_ZERO(&mask);
+	  CPU_SET(iCore,&mask);
+	  
+	  if(pthread_setaffinity_np(pthread_self(),sizeof(cpu_set_t),&mask)!=0)
+	    CRASHER<<"Unable to pin thread "<<threadId<<" to core "<<iCore<<endl;
+	}
+    }
+  }
+}
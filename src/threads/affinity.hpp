@@ -0,0 +1,54 @@
+#ifndef _AFFINITY_HPP
+#define _AFFINITY_HPP
+
+/// \file affinity.hpp
+///
+/// \brief Pins the threads of the pool to the cores
+///
+/// The policy is chosen through the THREAD_AFFINITY flag, which can
+/// be "none", "compact" (consecutive threads on consecutive cores),
+/// "scatter" (consecutive threads on different sockets, round-robin)
+/// or an explicit comma separated list of cores, such as "0,2,4,6".
+/// Only the cores available to the process are used.
+
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+#include <string>
+#include <vector>
+
+#ifndef EXTERN_AFFINITY
+# define EXTERN_AFFINITY extern
+#endif
+
+namespace ciccios
+{
+  namespace ThreadPool
+  {
+    /// Policy used to pin the threads, as read from the environment
+    EXTERN_AFFINITY std::string threadAffinity;
+    
+    namespace resources
+    {
+      /// Cores to which the threads are pinned
+      ///
+      /// Thread \c i is pinned to the core in position \c i modulo
+      /// the size of the list. An empty list means no pinning.
+      EXTERN_AFFINITY std::vector<int> coresOfThreads;
+    }
+    
+    /// Returns the list of cores to be used by the threads, according to the policy
+    std::vector<int> getCoresForThreads();
+    
+    /// Compute and print the cores to be used, to be called by master before pinning any thread
+    void setupAffinity(const int& nThreads);
+    
+    /// Pins the calling thread according to the chosen policy
+    void pinThread(const int& threadId);
+  }
+}
+
+#undef EXTERN_AFFINITY
+
+#endif
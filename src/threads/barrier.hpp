@@ -0,0 +1,174 @@
+#ifndef _BARRIER_HPP
+#define _BARRIER_HPP
+
+/// \file barrier.hpp
+///
+/// \brief Barriers among a fixed set of threads
+///
+/// Two barriers are provided: a centralized one, where all threads
+/// increment a shared counter, and a dissemination one, where each
+/// thread only writes to the padded flags of another thread in each of
+/// the log2(n) rounds. Both use sense reversal, so they can be reused
+/// without reinitialization.
+
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+#include <atomic>
+#include <vector>
+
+#include <base/inliner.hpp>
+#include <threads/loopSchedule.hpp>
+#include <threads/waitPolicy.hpp>
+
+namespace ciccios
+{
+  namespace ThreadPool
+  {
+    /// Barrier based on a single shared counter
+    class CentralBarrier
+    {
+      /// Local sense of each thread, padded
+      struct alignas(CACHE_LINE_SIZE) LocalSense
+      {
+	/// Sense
+	int sense;
+      };
+      
+      /// Number of threads taking part to the barrier
+      const int nParticipants;
+      
+      /// Number of threads arrived
+      alignas(CACHE_LINE_SIZE) std::atomic<int> nArrived;
+      
+      /// Global sense, flipped by the last arriving thread
+      alignas(CACHE_LINE_SIZE) std::atomic<int> globalSense;
+      
+      /// Local sense of each thread
+      std::vector<LocalSense> localSenses;
+      
+    public:
+      
+      /// Create the barrier for the given number of threads
+      CentralBarrier(const int& nParticipants) :
+	nParticipants(nParticipants),
+	nArrived(0),
+	globalSense(0),
+	localSenses(nParticipants,LocalSense{0})
+      {
+      }
+      
+      /// Wait that all threads reach the barrier
+      void wait(const int& threadId)
+      {
+	/// Sense of this passage
+	const int sense=
+	  (localSenses[threadId].sense^=1);
+	
+	if(nArrived.fetch_add(1,std::memory_order_acq_rel)==nParticipants-1)
+	  {
+	    nArrived.store(0,std::memory_order_relaxed);
+	    globalSense.store(sense,std::memory_order_release);
+	  }
+	else
+	  waitWithoutParkingUntil([this,sense]()
+				  {
+				    return globalSense.load(std::memory_order_acquire)==sense;
+				  });
+      }
+    };
+    
+    /// Dissemination barrier
+    ///
+    /// In round \c r each thread signals the thread at distance
+    /// 2^r, and waits for the signal of the thread at the same
+    /// distance behind it. After ceil(log2(n)) rounds all threads
+    /// have transitively heard from all others.
+    class DisseminationBarrier
+    {
+      /// Maximal number of rounds, enough for 65536 threads
+      static constexpr int MAX_N_ROUNDS=16;
+      
+      /// Flags and state of a thread, padded
+      struct alignas(CACHE_LINE_SIZE) ThreadState
+      {
+	/// Flags written by the partners, for each parity and round
+	std::atomic<int> flags[2][MAX_N_ROUNDS];
+	
+	/// Parity currently in use
+	int parity;
+	
+	/// Sense currently in use
+	int sense;
+	
+	/// Initialize the flags to the opposite of the sense
+	ThreadState() :
+	  parity(0),
+	  sense(1)
+	{
+	  for(int iParity=0;iParity<2;iParity++)
+	    for(int iRound=0;iRound<MAX_N_ROUNDS;iRound++)
+	      flags[iParity][iRound].store(0,std::memory_order_relaxed);
+	}
+      };
+      
+      /// Number of threads taking part to the barrier
+      const int nParticipants;
+      
+      /// Number of rounds
+      int nRounds;
+      
+      /// State of each thread
+      std::vector<ThreadState> states;
+      
+    public:
+      
+      /// Create the barrier for the given number of threads
+      DisseminationBarrier(const int& nParticipants) :
+	nParticipants(nParticipants),
+	nRounds(0),
+	states(nParticipants)
+      {
+	while((1<<nRounds)<nParticipants)
+	  nRounds++;
+      }
+      
+      /// Wait that all threads reach the barrier
+      void wait(const int& threadId)
+      {
+	/// State of the thread
+	ThreadState& state=
+	  states[threadId];
+	
+	/// Sense of this passage
+	const int sense=
+	  state.sense;
+	
+	for(int iRound=0;iRound<nRounds;iRound++)
+	  {
+	    /// Thread to be signaled
+	    const int partner=
+	      (threadId+(1<<iRound))%nParticipants;
+	    
+	    states[partner].flags[state.parity][iRound].store(sense,std::memory_order_release);
+	    
+	    /// Flag to be waited
+	    std::atomic<int>& flag=
+	      state.flags[state.parity][iRound];
+	    
+	    waitWithoutParkingUntil([&flag,sense]()
+				    {
+				      return flag.load(std::memory_order_acquire)==sense;
+				    });
+	  }
+	
+	if(state.parity==1)
+	  state.sense^=1;
+	state.parity^=1;
+      }
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef _INPLACE_WORK_HPP
+#define _INPLACE_WORK_HPP
+
+/// \file inplaceWork.hpp
+///
+/// \brief Fixed capacity container of the work given to the pool
+///
+/// Differently from \c std::function, the callable object is always
+/// stored inside the container, so that assigning a work never
+/// allocates memory. A callable too large to fit is rejected at
+/// compile time.
+
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <base/inliner.hpp>
+
+namespace ciccios
+{
+  namespace ThreadPool
+  {
+    /// Type-erased callable with signature void(int), stored in place
+    template <int CAPACITY>        // Maximal size of the callable
+    class InplaceWork
+    {
+      /// Storage for the callable
+      alignas(std::max_align_t) unsigned char storage[CAPACITY];
+      
+      /// Calls the stored callable
+      void (*invoker)(void* obj,int threadId);
+      
+      /// Destroys the stored callable
+      void (*destroyer)(void* obj);
+      
+    public:
+      
+      /// Creates an empty work
+      InplaceWork() :
+	invoker(nullptr),
+	destroyer(nullptr)
+      {
+      }
+      
+      /// Forbids copy, the work is only assigned
+      InplaceWork(const InplaceWork&)=delete;
+      
+      /// Forbids copy assignment
+      InplaceWork& operator=(const InplaceWork&)=delete;
+      
+      /// Destroys the stored callable, if any
+      void reset()
+      {
+	if(destroyer)
+	  destroyer(storage);
+	
+	invoker=nullptr;
+	destroyer=nullptr;
+      }
+      
+      /// Stores a new callable, destroying the previous one
+      template <typename F>
+      InplaceWork& operator=(F&& f)
+      {
+	/// Type actually stored
+	using Fun=
+	  std::decay_t<F>;
+	
+	static_assert(sizeof(Fun)<=CAPACITY,"Work too large to be stored in place, capture less by value or increase MAX_POOL_FUNCTION_SIZE");
+	static_assert(alignof(Fun)<=alignof(std::max_align_t),"Work requires an alignment larger than the storage one");
+	
+	reset();
+	
+	new(storage) Fun(std::forward<F>(f));
+	
+	invoker=
+	  [](void* obj,int threadId)
+	  {
+	    (*static_cast<Fun*>(obj))(threadId);
+	  };
+	
+	destroyer=
+	  [](void* obj)
+	  {
+	    static_cast<Fun*>(obj)->~Fun();
+	  };
+	
+	return *this;
+      }
+      
+      /// Runs the work
+      INLINE_FUNCTION
+      void operator()(const int& threadId)
+      {
+	invoker(storage,threadId);
+      }
+      
+      /// Destroys the stored callable
+      ~InplaceWork()
+      {
+	reset();
+      }
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,273 @@
+#ifndef _LOOP_SCHEDULE_HPP
+#define _LOOP_SCHEDULE_HPP
+
+/// \file loopSchedule.hpp
+///
+/// \brief Defines how the iterations of a loop are scheduled among threads
+
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <numeric>
+
+namespace ciccios
+{
+  /// Size of a cache line, used to pad variables shared among threads
+  constexpr int CACHE_LINE_SIZE=64;
+  
+  namespace ThreadPool
+  {
+    /// Kind of scheduling of the iterations of a loop among threads
+    enum class ScheduleKind{STATIC,        ///< Split into \c nThreads contiguous blocks
+			    STATIC_CHUNK,  ///< Chunks of fixed size assigned round-robin
+			    DYNAMIC,       ///< Chunks of fixed size taken from a shared counter
+			    GUIDED};       ///< Chunks proportional to the remaining iterations, taken from a shared counter
+    
+    /// Scheduling of a loop
+    ///
+    /// The boundaries of the chunks, counted from the beginning of the
+    /// loop, are multiple of \c alignment. If each iteration covers
+    /// a given amount of memory starting at an aligned address,
+    /// \c alignToCacheLines ensures that no cache line is split among
+    /// threads, while \c alignTo can be used to keep whole SIMD fused
+    /// sites together.
+    ///
+    /// A hook can be set to be called by each thread with the
+    /// boundaries of every chunk it is assigned, before running it.
+    struct LoopSchedule
+    {
+      /// Function called with beginning and end of each chunk
+      using ChunkHook=
+	std::function<void(const int64_t&,const int64_t&)>;
+      
+      /// Kind of scheduling
+      ScheduleKind kind;
+      
+      /// Size of the chunks, minimal size for guided; automatically chosen if 0
+      int64_t chunkSize;
+      
+      /// Chunk boundaries are multiple of this
+      int64_t alignment;
+      
+      /// Decide at runtime how many threads to use, according to the cost of the loop, if asked
+      bool adaptive;
+      
+      /// Cost of each iteration in seconds, measured at runtime if 0
+      double costPerIteration;
+      
+      /// Called by the running thread before each chunk, if set
+      ChunkHook onChunk;
+      
+      /// Construct specifying the kind and possibly the chunk size
+      LoopSchedule(const ScheduleKind& kind=ScheduleKind::STATIC,
+		   const int64_t& chunkSize=0) :
+	kind(kind),
+	chunkSize(chunkSize),
+	alignment(1),
+	adaptive(false),
+	costPerIteration(0)
+      {
+      }
+      
+      /// Let the loop decide how many threads to use, running it serially if too cheap
+      ///
+      /// Only to be asked when the assignment of the iterations to the
+      /// threads does not matter
+      LoopSchedule& adaptively()
+      {
+	adaptive=
+	  true;
+	
+	return *this;
+      }
+      
+      /// Provide the cost of each iteration in seconds, instead of measuring it, and let the loop adapt
+      LoopSchedule& withCostPerIteration(const double& cost)
+      {
+	adaptive=
+	  true;
+	
+	costPerIteration=
+	  cost;
+	
+	return *this;
+      }
+      
+      /// Set the function to be called by the running thread with the boundaries of each chunk
+      LoopSchedule& onEachChunk(const ChunkHook& hook)
+      {
+	onChunk=
+	  hook;
+	
+	return *this;
+      }
+      
+      /// Require the chunks to be multiple of \c n iterations
+      LoopSchedule& alignTo(const int64_t& n)
+      {
+	alignment=
+	  std::lcm(alignment,n);
+	
+	return *this;
+      }
+      
+      /// Require the chunks to cover entire cache lines, given the memory spanned by each iteration
+      LoopSchedule& alignToCacheLines(const int64_t& bytesPerIteration)
+      {
+	return
+	  alignTo(CACHE_LINE_SIZE/std::gcd((int64_t)CACHE_LINE_SIZE,bytesPerIteration));
+      }
+      
+      /// Round up to the alignment
+      int64_t aligned(const int64_t& n)
+	const
+      {
+	return
+	  (n+alignment-1)/alignment*alignment;
+      }
+      
+      /// Size of the chunks to be used for the given loop length
+      int64_t getChunkSize(const int64_t& length,
+			   const int& nPieces)
+	const
+      {
+	/// Chunk size, before alignment
+	int64_t res=
+	  chunkSize;
+	
+	// Aim at a few chunks per thread
+	if(res<=0)
+	  res=(kind==ScheduleKind::GUIDED)?1:(length/(8*nPieces));
+	
+	return
+	  aligned(std::max<int64_t>(1,res));
+      }
+    };
+    
+    /// Estimate of the cost of an iteration of a loop
+    ///
+    /// Updated with an exponential moving average of the measured
+    /// time, only by the master thread
+    struct LoopCostEstimate
+    {
+      /// Cost of each iteration in seconds, 0 if not yet measured
+      double costPerIteration{0};
+      
+      /// Accounts for the time spent running the given number of iterations
+      void update(const double& time,
+		  const int64_t& nIterations)
+      {
+	if(nIterations>0)
+	  {
+	    /// Measured cost
+	    const double measured=
+	      time/nIterations;
+	    
+	    if(costPerIteration==0)
+	      costPerIteration=measured;
+	    else
+	      costPerIteration=0.75*costPerIteration+0.25*measured;
+	  }
+      }
+    };
+    
+    /// Estimate of the cost of the loops run with a given kernel
+    ///
+    /// Each lambda has its own type, so that this identifies the
+    /// call site of the loop
+    template <typename F>
+    LoopCostEstimate& costEstimateOf()
+    {
+      /// Estimate, one per kernel type
+      static LoopCostEstimate estimate;
+      
+      return estimate;
+    }
+    
+    /// Call \c f on each chunk of the loop [0,length) assigned to the thread by the schedule
+    ///
+    /// Dynamic and guided schedules require a counter shared among
+    /// threads, to be reset before the loop starts
+    template <typename F>
+    void forEachScheduledChunk(const int64_t& length,          ///< Length of the loop
+			       const int& threadId,            ///< Calling thread
+			       const int& nPieces,             ///< Number of threads
+			       const LoopSchedule& schedule,   ///< Scheduling
+			       std::atomic<int64_t>* counter,  ///< Counter of the iterations taken, for dynamic and guided schedules
+			       const F& f)                     ///< Function getting beginning and end of the chunk
+    {
+      switch(schedule.kind)
+	{
+	case ScheduleKind::STATIC:
+	  {
+	    /// Workload for each thread
+	    const int64_t threadLoad=
+	      schedule.aligned((length+nPieces-1)/nPieces);
+	    
+	    /// Beginning of the chunk
+	    const int64_t chunkBeg=
+	      std::min(length,threadLoad*threadId);
+	    
+	    f(chunkBeg,std::min(length,chunkBeg+threadLoad));
+	  }
+	  break;
+	case ScheduleKind::STATIC_CHUNK:
+	  {
+	    /// Size of the chunks
+	    const int64_t chunkSize=
+	      schedule.getChunkSize(length,nPieces);
+	    
+	    for(int64_t chunkBeg=chunkSize*threadId;chunkBeg<length;chunkBeg+=chunkSize*nPieces)
+	      f(chunkBeg,std::min(length,chunkBeg+chunkSize));
+	  }
+	  break;
+	case ScheduleKind::DYNAMIC:
+	  {
+	    /// Size of the chunks
+	    const int64_t chunkSize=
+	      schedule.getChunkSize(length,nPieces);
+	    
+	    /// Beginning of the chunk taken
+	    int64_t chunkBeg;
+	    
+	    while((chunkBeg=counter->fetch_add(chunkSize,std::memory_order_relaxed))<length)
+	      f(chunkBeg,std::min(length,chunkBeg+chunkSize));
+	  }
+	  break;
+	case ScheduleKind::GUIDED:
+	  {
+	    /// Minimal size of the chunks
+	    const int64_t minChunkSize=
+	      schedule.getChunkSize(length,nPieces);
+	    
+	    /// Beginning of the chunk to be taken
+	    int64_t chunkBeg=
+	      counter->load(std::memory_order_relaxed);
+	    
+	    while(chunkBeg<length)
+	      {
+		/// Size of the chunk, proportional to the remaining iterations
+		const int64_t chunkSize=
+		  schedule.aligned(std::max(minChunkSize,(length-chunkBeg)/(2*nPieces)));
+		
+		if(counter->compare_exchange_weak(chunkBeg,chunkBeg+chunkSize,std::memory_order_relaxed))
+		  {
+		    f(chunkBeg,std::min(length,chunkBeg+chunkSize));
+		    
+		    chunkBeg=
+		      counter->load(std::memory_order_relaxed);
+		  }
+	      }
+	  }
+	  break;
+	}
+    }
+  }
+}
+
+#endif
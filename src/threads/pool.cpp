@@ -27,21 +27,308 @@ namespace ciccios
       // Delete the pars, which have been passed as new int
       delete pars;
       
+      pinThread(threadId);
+      
+      // Workers only run inside a work
+      resources::isExecutingWork=true;
+      
       do
 	{
-	  resources::waitForWork();
+	  resources::waitForWork(threadId);
 	  
-	  work(threadId);
+	  executeWork(threadId);
 	}
       while(poolIsStarted);
       
       return nullptr;
     }
+    
+    bool SpinBackend::dispatch(const int&)
+    {
+      nWorksAssigned.store(nWorksAssigned+1);
+      notifyParked(nWorksAssigned,nParkedWorkers);
+      
+      resources::isExecutingWork=true;
+      executeWork(masterThreadId);
+      resources::isExecutingWork=false;
+      
+      return true;
+    }
+    
+    void SpinBackend::waitCompletion()
+    {
+      waitForChildrenArrival(masterThreadId,nWorksAssigned.load(std::memory_order_relaxed));
+    }
+    
+    bool SpinBackend::isCompleted()
+    {
+      /// Latest work assigned
+      const int iWork=
+	nWorksAssigned.load(std::memory_order_relaxed);
+      
+      /// Check if all the subtrees of the master have completed the work
+      bool res=
+	true;
+      
+      for(int childId=1;childId<=ARRIVAL_TREE_FAN_IN and childId<nThreads;childId++)
+	res&=
+	  (resources::arrivalFlags[childId].work.load(std::memory_order_acquire)==iWork);
+      
+      return
+	res;
+    }
+    
+    OpenMPBackend::OpenMPBackend()
+    {
+      if(not useDetachedPool)
+	CRASHER<<"The OpenMP backend needs the detached pool, the OpenMP regions would be nested inside the one of the workers"<<endl;
+    }
+    
+    bool OpenMPBackend::dispatch(const int& nParticipants)
+    {
+      omp_set_dynamic(0);
+      
+      /// Number of threads granted by OpenMP
+      int nGrantedThreads=
+	nParticipants;
+      
+#pragma omp parallel num_threads(nParticipants)
+      {
+	/// Number of threads of the region, the same for all of them
+	const int nRegionThreads=
+	  omp_get_num_threads();
+	
+	if(omp_get_thread_num()==masterThreadId)
+	  nGrantedThreads=nRegionThreads;
+	
+	if(nRegionThreads==nParticipants)
+	  {
+	    resources::isExecutingWork=true;
+	    executeWork(omp_get_thread_num());
+	    resources::isExecutingWork=false;
+	  }
+      }
+      
+      return
+	nGrantedThreads==nParticipants;
+    }
+    
+    CondVarBackend::CondVarBackend() :
+      nWorksAssigned(0),
+      nWorkersCompleted(nThreads-1),
+      isActive(true)
+    {
+      for(int threadId=1;threadId<nThreads;threadId++)
+	workers.emplace_back(&CondVarBackend::workerLoop,this,threadId);
+    }
+    
+    CondVarBackend::~CondVarBackend()
+    {
+      waitCompletion();
+      
+      {
+	/// Lock on the state
+	std::lock_guard<std::mutex> lock(mutex);
+	
+	isActive=false;
+      }
+      
+      workAssigned.notify_all();
+      
+      for(std::thread& worker : workers)
+	worker.join();
+    }
+    
+    void CondVarBackend::workerLoop(const int& threadId)
+    {
+      pinThread(threadId);
+      
+      // Workers only run inside a work
+      resources::isExecutingWork=true;
+      
+      /// Number of works already executed
+      int nWorksExecuted=0;
+      
+      while(true)
+	{
+	  {
+	    /// Lock on the state
+	    std::unique_lock<std::mutex> lock(mutex);
+	    
+	    workAssigned.wait(lock,[this,nWorksExecuted]()
+			      {
+				return nWorksAssigned!=nWorksExecuted or not isActive;
+			      });
+	    
+	    if(not isActive)
+	      return;
+	    
+	    nWorksExecuted=nWorksAssigned;
+	  }
+	  
+	  executeWork(threadId);
+	  
+	  /// Check if this is the last thread completing the work
+	  bool isLast;
+	  
+	  {
+	    /// Lock on the state
+	    std::lock_guard<std::mutex> lock(mutex);
+	    
+	    isLast=(++nWorkersCompleted==nThreads-1);
+	  }
+	  
+	  if(isLast)
+	    workCompleted.notify_all();
+	}
+    }
+    
+    bool CondVarBackend::dispatch(const int&)
+    {
+      {
+	/// Lock on the state
+	std::lock_guard<std::mutex> lock(mutex);
+	
+	nWorkersCompleted=0;
+	nWorksAssigned++;
+      }
+      
+      workAssigned.notify_all();
+      
+      resources::isExecutingWork=true;
+      executeWork(masterThreadId);
+      resources::isExecutingWork=false;
+      
+      return true;
+    }
+    
+    void CondVarBackend::waitCompletion()
+    {
+      /// Lock on the state
+      std::unique_lock<std::mutex> lock(mutex);
+      
+      workCompleted.wait(lock,[this]()
+			 {
+			   return nWorkersCompleted==nThreads-1;
+			 });
+    }
+    
+    bool CondVarBackend::isCompleted()
+    {
+      /// Lock on the state
+      std::lock_guard<std::mutex> lock(mutex);
+      
+      return
+	nWorkersCompleted==nThreads-1;
+    }
+    
+    int64_t getCompletedPoolEpoch()
+    {
+      /// Epoch to be checked, read before the state of the work, which was assigned before advancing it
+      const int64_t epoch=
+	resources::poolEpoch.load();
+      
+      if(poolIsStarted and resources::completedPoolEpoch.load()!=epoch and resources::backend->isCompleted())
+	resources::markPoolEpochCompleted(epoch);
+      
+      return resources::completedPoolEpoch.load();
+    }
+    
+    PoolBackend* makeBackend(const std::string& name)
+    {
+      if(name=="spin")
+	return new SpinBackend;
+      
+      if(name=="openmp")
+	return new OpenMPBackend;
+      
+      if(name=="condvar")
+	return new CondVarBackend;
+      
+      CRASHER<<"Unknown backend "<<name<<", use spin, openmp or condvar"<<endl;
+      
+      return nullptr;
+    }
+    
+    void setBackend(PoolBackend* backend)
+    {
+      if(not canDispatchWork() or resources::currentTeam)
+	CRASHER<<"The backend can only be changed by the master, outside any work"<<endl;
+      
+      waitThatAllWorkersWaitForWork();
+      
+      resources::backend.reset(backend);
+    }
+#endif
+
+#ifdef USE_THREADS
+    double getDispatchOverhead()
+    {
+      /// Overhead of the current backend
+      double& dispatchOverhead=
+	resources::backend->dispatchOverhead;
+      
+      if(dispatchOverhead==0)
+	{
+	  /// Number of dispatches to be averaged
+	  const int nDispatches=
+	    16;
+	  
+	  waitThatAllWorkersWaitForWork();
+	  
+	  /// Takes note of starting moment
+	  const Instant start=
+	    takeTime();
+	  
+	  for(int i=0;i<nDispatches;i++)
+	    {
+	      parallel([](const int&){});
+	      waitThatAllWorkersWaitForWork();
+	    }
+	  
+	  dispatchOverhead=
+	    timeDiffInSec(takeTime(),start)/nDispatches;
+	  
+	  LOGGER<<"Measured dispatch overhead of the "<<resources::backend->name()<<" backend: "<<dispatchOverhead*1e6<<" us"<<endl;
+	}
+      
+      return dispatchOverhead;
+    }
+    
+    void printWaitStatistics()
+    {
+      LOGGER<<"Waiting policy: "<<nWaitSpinIterations<<" spin iterations, "<<nWaitYieldIterations<<" yield iterations, then park"<<endl;
+      
+      for(int threadId=1;threadId<nThreads;threadId++)
+	{
+	  /// Statistics of the thread
+	  const WaitStatistics& s=
+	    resources::waitStatistics[threadId];
+	  
+	  /// Total number of waits
+	  const int64_t nWaits=
+	    s.nWaitsEndedIn[0]+s.nWaitsEndedIn[1]+s.nWaitsEndedIn[2];
+	  
+	  if(nWaits)
+	    LOGGER<<" thread "<<threadId<<": "<<nWaits<<" waits, ended spinning: "<<s.nWaitsEndedIn[(int)WaitPhase::SPIN]<<
+	      ", yielding: "<<s.nWaitsEndedIn[(int)WaitPhase::YIELD]<<
+	      ", parked: "<<s.nWaitsEndedIn[(int)WaitPhase::PARK]<<
+	      ", wake up latency average: "<<s.totWakeUpLatency/nWaits*1e6<<" us"<<
+	      ", max: "<<s.maxWakeUpLatency*1e6<<" us"<<endl;
+	}
+    }
 #endif
     
     void poolStop()
     {
 #ifdef USE_THREADS
+      // Back to the pool workers, which must be stopped
+      setBackend(new SpinBackend);
+      
+      // Summarize the works before the last one, which lets the workers leave
+      waitThatAllWorkersWaitForWork();
+      printWorkProfile();
+      
       // Gives all worker a trivial work: mark the pool as not started
       parallel([](const int&)
 	       {
@@ -58,6 +345,9 @@ namespace ciccios
 	  // Remove all pthreads
 	  resources::pool.resize(0);
 	}
+      
+      if(useWaitStatistics)
+	printWaitStatistics();
 #endif
     }
   }
@@ -10,15 +10,24 @@
 #endif
 
 #include <atomic>
-#include <functional>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <omp.h>
+#include <string>
+#include <thread>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 #include <base/debug.hpp>
-
-// This seems not to be working well, but should be checked again
-//#include <external/inplace_function.h>
+#include <base/scratchArena.hpp>
+#include <threads/affinity.hpp>
+#include <threads/inplaceWork.hpp>
+#include <threads/loopSchedule.hpp>
+#include <threads/waitPolicy.hpp>
+#include <threads/workProfile.hpp>
 
 #ifndef EXTERN_POOL
 # define EXTERN_POOL extern
@@ -74,24 +83,242 @@ namespace ciccios
     {
       /// Incapsulate the threads
       EXTERN_POOL std::vector<pthread_t> pool;
+      
+      /// Store whether the calling thread is executing a work
+      EXTERN_POOL thread_local bool isExecutingWork INIT_POOL_TO(false);
     }
     
-    /// Maximal size of the stack used for thw work
-    //static constexpr int MAX_POOL_FUNCTION_SIZE=128;
+    /// Interface of the implementations used to run the works
+    ///
+    /// The work to be run is stored in \c work before the dispatch,
+    /// and each started thread calls \c executeWork with its id, the
+    /// calling thread taking part to it as the master. All started
+    /// threads run the work concurrently, so that they can
+    /// synchronize through barriers, as in \c region and \c runTeams.
+    class PoolBackend
+    {
+    public:
+      
+      /// Time needed to dispatch a work and wait for its completion, 0 if not yet measured
+      double dispatchOverhead;
+      
+      /// Not yet measured overhead
+      PoolBackend() :
+	dispatchOverhead(0)
+      {
+      }
+      
+      /// Name of the backend
+      virtual const char* name()
+	const=0;
+      
+      /// Check whether only the threads taking part to a work are started, so that a loop can be run on a subset of threads
+      virtual bool startsOnlyParticipants()
+	const=0;
+      
+      /// Starts the work on the first \a nParticipants threads, the master included
+      ///
+      /// The other threads might be started as well, and must then
+      /// be ignored by the work. The completion is not necessarily
+      /// waited. Returns false if the work could not be started, in
+      /// which case no thread has run it.
+      virtual bool dispatch(const int& nParticipants)=0;
+      
+      /// Wait that all threads have completed the latest work
+      virtual void waitCompletion()=0;
+      
+      /// Check, without waiting, if all threads have completed the latest work
+      virtual bool isCompleted()=0;
+      
+      /// Destroy the backend, after the completion of the latest work
+      virtual ~PoolBackend()
+      {
+      }
+    };
+    
+    /// Name of the backend to be used, as read from the environment
+    EXTERN_POOL std::string backendName;
+    
+    /// Creates the backend with the given name, among "spin", "openmp" and "condvar"
+    PoolBackend* makeBackend(const std::string& name);
+    
+    /// Change the backend used to run the works, to be called by master outside any work
+    ///
+    /// The works assigned through the previous backend are completed
+    /// before switching, and the previous backend destroyed. The pool
+    /// takes the ownership of the new one.
+    void setBackend(PoolBackend* backend);
     
-    /// Number of threads waiting for work
-    EXTERN_POOL std::atomic<int> nThreadsWaitingForWork INIT_POOL_TO(0);
+    /// Maximal size of the callable given as a work
+    static constexpr int MAX_POOL_FUNCTION_SIZE=256;
     
     /// Count the number of assigned works
-    EXTERN_POOL std::atomic<int> nWorksAssigned INIT_POOL_TO(0);
+    alignas(CACHE_LINE_SIZE) EXTERN_POOL std::atomic<int> nWorksAssigned INIT_POOL_TO(0);
+    
+    /// Number of workers parked waiting for new work
+    alignas(CACHE_LINE_SIZE) EXTERN_POOL std::atomic<int> nParkedWorkers INIT_POOL_TO(0);
+    
+    /// Determine whether to collect the statistics on the waiting of the workers
+    EXTERN_POOL bool useWaitStatistics;
+    
+    /// Moment at which the latest work has been assigned, taken only if wait statistics are collected or works profiled
+    alignas(CACHE_LINE_SIZE) EXTERN_POOL Instant workAssignmentInstant;
+    
+    /// Number of children of each node of the arrival tree
+    static constexpr int ARRIVAL_TREE_FAN_IN=4;
+    
+    /// Flag signaling that a thread and all its subtree have completed a work
+    ///
+    /// Threads are arranged in a tree, each thread waiting for its
+    /// children before signaling its parent, so that the master only
+    /// waits for its own children, and no counter is shared by all
+    /// threads
+    struct alignas(CACHE_LINE_SIZE) ArrivalFlag
+    {
+      /// Last work completed by the subtree
+      std::atomic<int> work;
+      
+      /// Number of threads parked waiting for the flag, the parent only
+      std::atomic<int> nParked;
+      
+      /// No work completed at the beginning
+      ArrivalFlag() :
+	work(-1),
+	nParked(0)
+      {
+      }
+    };
+    
+    namespace resources
+    {
+      /// Arrival flag of each thread
+      EXTERN_POOL std::vector<ArrivalFlag> arrivalFlags;
+    }
+    
+    /// Wait that the thread and its subtree have completed the given work
+    INLINE_FUNCTION
+    void waitForSubtreeArrival(const int& threadId, ///< Root of the subtree
+			       const int& iWork)    ///< Work to be completed
+    {
+      /// Flag of the thread
+      ArrivalFlag& flag=
+	resources::arrivalFlags[threadId];
+      
+      waitUntil(flag.work,flag.nParked,
+		[&flag,iWork]()
+		{
+		  return flag.work.load(std::memory_order_acquire)==iWork;
+		});
+    }
+    
+    /// Wait that all the children of the thread have completed the given work
+    INLINE_FUNCTION
+    void waitForChildrenArrival(const int& threadId, ///< Parent thread
+				const int& iWork)    ///< Work to be completed
+    {
+      for(int childId=ARRIVAL_TREE_FAN_IN*threadId+1;
+	  childId<=ARRIVAL_TREE_FAN_IN*threadId+ARRIVAL_TREE_FAN_IN and childId<nThreads;
+	  childId++)
+	waitForSubtreeArrival(childId,iWork);
+    }
+    
+    /// Statistics on the waiting of a thread for new work
+    struct alignas(CACHE_LINE_SIZE) WaitStatistics
+    {
+      /// Number of waits ended in each phase
+      int64_t nWaitsEndedIn[3];
+      
+      /// Total time elapsed between the assignment of the work and the wake up
+      double totWakeUpLatency;
+      
+      /// Maximal time elapsed between the assignment of the work and the wake up
+      double maxWakeUpLatency;
+      
+      /// Account for a wait
+      void account(const WaitPhase& phase,
+		   const double& wakeUpLatency)
+      {
+	nWaitsEndedIn[(int)phase]++;
+	totWakeUpLatency+=wakeUpLatency;
+	maxWakeUpLatency=std::max(maxWakeUpLatency,wakeUpLatency);
+      }
+      
+      /// Starts with no wait
+      WaitStatistics() :
+	nWaitsEndedIn{0,0,0},
+	totWakeUpLatency(0),
+	maxWakeUpLatency(0)
+      {
+      }
+    };
+    
+    namespace resources
+    {
+      /// Waiting statistics of each thread
+      EXTERN_POOL std::vector<WaitStatistics> waitStatistics;
+    }
+    
+    /// Prints the statistics on the waiting of the workers
+    void printWaitStatistics();
     
     /// States if the pool is started
     EXTERN_POOL bool poolIsStarted INIT_POOL_TO(false);
     
+    namespace resources
+    {
+      /// Number of works dispatched by the master, through any backend
+      ///
+      /// Advanced only after the work has been assigned, so that a
+      /// thread reading the epoch sees the corresponding work
+      EXTERN_POOL std::atomic<int64_t> poolEpoch INIT_POOL_TO(0);
+      
+      /// Number of works dispatched by the master known to be completed
+      EXTERN_POOL std::atomic<int64_t> completedPoolEpoch INIT_POOL_TO(0);
+      
+      /// Mark as completed the works up to the given epoch
+      ///
+      /// Can be called by any thread, the completed epoch never
+      /// decreases
+      INLINE_FUNCTION
+      void markPoolEpochCompleted(const int64_t& epoch)
+      {
+	/// Epoch previously marked as completed
+	int64_t prev=
+	  completedPoolEpoch.load();
+	
+	while(prev<epoch and not completedPoolEpoch.compare_exchange_weak(prev,epoch))
+	  {
+	  }
+      }
+    }
+    
+    /// Number of works dispatched by the master so far
+    ///
+    /// Memory released now can be used only by works up to this epoch
+    INLINE_FUNCTION
+    int64_t getPoolEpoch()
+    {
+      return resources::poolEpoch.load();
+    }
+    
+    /// Returns the latest epoch completed, checking without waiting if all works have been completed
+    int64_t getCompletedPoolEpoch();
+    
+    /// Decide at runtime how many threads to use in \c loopSplit
+    EXTERN_POOL bool useAdaptiveLoopSplit;
+    
+    /// Measure the time needed to dispatch a work and wait for its completion, with the current backend
+    double getDispatchOverhead();
+    
     /// Type to encapsulate the work to be done
     using Work=
-      std::function<void(int)>;
-    //stdext::inplace_function<void(int),MAX_POOL_FUNCTION_SIZE>;
+      InplaceWork<MAX_POOL_FUNCTION_SIZE>;
+    
+    namespace resources
+    {
+      /// Counter of the iterations already taken by threads, in dynamic and guided loops
+      alignas(CACHE_LINE_SIZE) EXTERN_POOL std::atomic<int64_t> loopChunkCounter;
+    }
     
     /// Work to be done in the pool
     ///
@@ -99,6 +326,305 @@ namespace ciccios
     /// integer as an argument, corresponding to the thread
     EXTERN_POOL Work work;
     
+    /// Count the number of works dispatched through any backend
+    EXTERN_POOL int nWorksDispatched INIT_POOL_TO(0);
+    
+    /// Execute the work as the given thread, taking note of the timings if profiling
+    INLINE_FUNCTION
+    void executeWork(const int& threadId)
+    {
+      if(not useWorkProfiling)
+	work(threadId);
+      else
+	{
+	  /// Takes note of starting moment
+	  const Instant begin=
+	    takeTime();
+	  
+	  work(threadId);
+	  
+	  // The index and moment of assignment are not changed until all threads complete the work
+	  resources::workRecords[threadId].add({nWorksDispatched,workAssignmentInstant,begin,takeTime()});
+	}
+    }
+    
+    class TeamDispatcher;
+    
+    namespace resources
+    {
+      /// Team to which the calling thread can dispatch work, if leading one
+      EXTERN_POOL thread_local TeamDispatcher* currentTeam INIT_POOL_TO(nullptr);
+    }
+    
+    /// Dispatcher of work to a team, a subset of the threads of the pool
+    ///
+    /// The members of the team other than the leader loop waiting for
+    /// work assigned by the leader, in the same way the workers of the
+    /// pool wait for the master. The leader takes part to the work as
+    /// the member of rank 0.
+    class TeamDispatcher
+    {
+      /// Number of threads in the team, including the leader
+      const int nMembers;
+      
+      /// Work to be done by the team
+      Work work;
+      
+      /// Count the number of assigned works
+      alignas(CACHE_LINE_SIZE) std::atomic<int> nWorksAssigned;
+      
+      /// Number of members parked waiting for new work
+      alignas(CACHE_LINE_SIZE) std::atomic<int> nParkedMembers;
+      
+      /// Counter of the iterations already taken by dynamic and guided loops
+      alignas(CACHE_LINE_SIZE) std::atomic<int64_t> loopChunkCounter;
+      
+      /// Set to false to let the members leave the team
+      alignas(CACHE_LINE_SIZE) std::atomic<bool> isActive;
+      
+      /// Arrival flag of each member
+      std::vector<ArrivalFlag> arrivalFlags;
+      
+    public:
+      
+      /// Creates the team with the given number of members
+      TeamDispatcher(const int& nMembers) :
+	nMembers(nMembers),
+	nWorksAssigned(0),
+	nParkedMembers(0),
+	loopChunkCounter(0),
+	isActive(true),
+	arrivalFlags(nMembers)
+      {
+      }
+      
+      /// Number of threads in the team
+      int getNMembers()
+	const
+      {
+	return nMembers;
+      }
+      
+      /// Counter to be used by dynamic and guided loops
+      std::atomic<int64_t>& getLoopChunkCounter()
+      {
+	return loopChunkCounter;
+      }
+      
+      /// Wait that all members have completed the work, to be called by the leader
+      void waitCompletion()
+      {
+	/// Last work assigned
+	const int iWork=
+	  nWorksAssigned.load(std::memory_order_relaxed);
+	
+	for(int rank=1;rank<nMembers;rank++)
+	  {
+	    /// Flag of the member
+	    ArrivalFlag& flag=
+	      arrivalFlags[rank];
+	    
+	    waitUntil(flag.work,flag.nParked,
+		      [&flag,iWork]()
+		      {
+			return flag.work.load(std::memory_order_acquire)==iWork;
+		      });
+	  }
+      }
+      
+      /// Assign the work to the team, to be called by the leader
+      ///
+      /// As for the pool, this does not wait for the completion of
+      /// the work
+      template <typename F>
+      void parallel(F&& f)
+      {
+	waitCompletion();
+	work=std::move(f);
+	
+	nWorksAssigned.store(nWorksAssigned+1);
+	notifyParked(nWorksAssigned,nParkedMembers);
+	
+	// Nested works issued by the leader while running its part are run serially
+	resources::currentTeam=nullptr;
+	work(0);
+	resources::currentTeam=this;
+      }
+      
+      /// Let the members leave the team, to be called by the leader
+      void stop()
+      {
+	parallel([this](const int&)
+		 {
+		   isActive=false;
+		 });
+      }
+      
+      /// Loop waiting for work, to be run by the members other than the leader
+      void memberLoop(const int& rank)
+      {
+	do
+	  {
+	    /// Previous number of work assigned
+	    const int prevNWorkAssigned=
+	      nWorksAssigned;
+	    
+	    /// Flag of the member
+	    ArrivalFlag& flag=
+	      arrivalFlags[rank];
+	    
+	    flag.work.store(prevNWorkAssigned);
+	    notifyParked(flag.work,flag.nParked);
+	    
+	    waitUntil(nWorksAssigned,nParkedMembers,
+		      [this,prevNWorkAssigned]()
+		      {
+			return nWorksAssigned.load(std::memory_order_relaxed)!=prevNWorkAssigned;
+		      });
+	    
+	    std::atomic_thread_fence(std::memory_order_acquire);
+	    
+	    work(rank);
+	  }
+	while(isActive);
+      }
+    };
+    
+    /// Backend in which the workers of the pool spin, and then park, waiting for work
+    class SpinBackend :
+      public PoolBackend
+    {
+    public:
+      
+      const char* name()
+	const
+      {
+	return "spin";
+      }
+      
+      bool startsOnlyParticipants()
+	const
+      {
+	return false;
+      }
+      
+      bool dispatch(const int& nParticipants);
+      
+      void waitCompletion();
+      
+      bool isCompleted();
+    };
+    
+    /// Backend opening an OpenMP parallel region for each work
+    ///
+    /// The completion is waited at the end of the region. Only the
+    /// detached pool can use it, as the workers of the not detached
+    /// pool run inside an OpenMP region, into which the regions of the
+    /// backend would be nested, oversubscribing the cores.
+    class OpenMPBackend :
+      public PoolBackend
+    {
+    public:
+      
+      /// Checks that the pool is detached
+      OpenMPBackend();
+      
+      const char* name()
+	const
+      {
+	return "openmp";
+      }
+      
+      bool startsOnlyParticipants()
+	const
+      {
+	return true;
+      }
+      
+      /// Fails if OpenMP does not grant all threads, because of a thread limit or of the nesting level
+      bool dispatch(const int& nParticipants);
+      
+      void waitCompletion()
+      {
+      }
+      
+      bool isCompleted()
+      {
+	return true;
+      }
+    };
+    
+    /// Backend in which its own threads wait for work on a condition variable
+    ///
+    /// The threads are created at construction and joined at
+    /// destruction.
+    class CondVarBackend :
+      public PoolBackend
+    {
+      /// Mutex protecting the state
+      std::mutex mutex;
+      
+      /// Signals that a work has been assigned, or that the backend is destroyed
+      std::condition_variable workAssigned;
+      
+      /// Signals that all threads completed the work
+      std::condition_variable workCompleted;
+      
+      /// Count the number of assigned works
+      int nWorksAssigned;
+      
+      /// Number of threads other than the master which completed the latest work
+      int nWorkersCompleted;
+      
+      /// Set to false to let the threads exit
+      bool isActive;
+      
+      /// Threads other than the master
+      std::vector<std::thread> workers;
+      
+      /// Loop waiting for work, run by the threads other than the master
+      void workerLoop(const int& threadId);
+      
+    public:
+      
+      /// Creates the threads
+      CondVarBackend();
+      
+      /// Stops and joins the threads
+      ~CondVarBackend();
+      
+      const char* name()
+	const
+      {
+	return "condvar";
+      }
+      
+      bool startsOnlyParticipants()
+	const
+      {
+	return false;
+      }
+      
+      bool dispatch(const int& nParticipants);
+      
+      void waitCompletion();
+      
+      bool isCompleted();
+    };
+    
+    namespace resources
+    {
+      /// Backend currently used
+      EXTERN_POOL std::unique_ptr<PoolBackend> backend;
+    }
+    
+    /// Backend currently used
+    INLINE_FUNCTION
+    PoolBackend& getBackend()
+    {
+      return *resources::backend;
+    }
+    
     /// Assert that only the pool is accessing
     inline void assertPoolOnly(const int& threadId) ///< Calling thread
     {
@@ -128,38 +654,112 @@ namespace ciccios
       return (threadId==masterThreadId);
     }
     
+    /// Check whether the calling thread can assign a work to the pool, or to its team
+    ///
+    /// This is false if the pool is not started, or if the calling
+    /// thread is already executing a work and is not leading a team
+    INLINE_FUNCTION
+    bool canDispatchWork()
+    {
+      return poolIsStarted and (resources::currentTeam or not resources::isExecutingWork);
+    }
+    
+    /// Number of threads onto which a work issued by the calling thread is run
+    ///
+    /// This is the size of the team led by the thread, if any, one if
+    /// the thread is executing a work, otherwise the whole pool
+    INLINE_FUNCTION
+    int getCurrentNThreads()
+    {
+      if(resources::currentTeam)
+	return resources::currentTeam->getNMembers();
+      
+      if(resources::isExecutingWork)
+	return 1;
+      
+      return nThreads;
+    }
+    
+    /// Returns whether the calling thread is executing a work of the pool
+    INLINE_FUNCTION
+    bool isInsideWork()
+    {
+      return resources::isExecutingWork;
+    }
+    
     /// Wait all workers are waiting for work
+    ///
+    /// If the calling thread leads a team, wait for its members
     INLINE_FUNCTION
     void waitThatAllWorkersWaitForWork()
     {
-      while(poolIsStarted and nThreadsWaitingForWork!=nThreads-1);
+      if(resources::currentTeam)
+	resources::currentTeam->waitCompletion();
+      else
+	if(poolIsStarted and not resources::isExecutingWork)
+	  {
+	    resources::backend->waitCompletion();
+	    
+	    resources::markPoolEpochCompleted(resources::poolEpoch.load());
+	  }
+    }
+    
+    /// Wait the completion of the works dispatched to the pool and possibly still running
+    ///
+    /// To be called before releasing memory which might be used by
+    /// the works; does nothing from inside a work, or if all works
+    /// dispatched are already known to be completed
+    INLINE_FUNCTION
+    void waitWorksInFlight()
+    {
+      if(not isInsideWork() and getPoolEpoch()>getCompletedPoolEpoch())
+	waitThatAllWorkersWaitForWork();
     }
     
     namespace resources
     {
       /// Wait that the count of the number of work has been increased
+      ///
+      /// Returns the phase in which the wait ended
       INLINE_FUNCTION
-      void waitThatMasterSignalsNewWork(const int& prevNWorkAssigned)
+      WaitPhase waitThatMasterSignalsNewWork(const int& prevNWorkAssigned)
       {
 	// The work will be assigned only when the master sees all workers waiting
-	while(nWorksAssigned.load(std::memory_order_relaxed)==prevNWorkAssigned);
+	return
+	  waitUntil(nWorksAssigned,nParkedWorkers,
+		    [prevNWorkAssigned]()
+		    {
+		      return
+			nWorksAssigned.load(std::memory_order_relaxed)!=prevNWorkAssigned;
+		    });
       }
       
       /// Wait for the work to come
       INLINE_FUNCTION
-      void waitForWork()
+      void waitForWork(const int& threadId) ///< Calling thread
       {
 	/// Previous numebr fo work assigned
 	const int prevNWorkAssigned=nWorksAssigned;
 	
-	// Increase the number of threads waiting for work
-	nThreadsWaitingForWork.fetch_add(1);
+	// Signal to the parent that the whole subtree has completed the work
+	waitForChildrenArrival(threadId,prevNWorkAssigned);
+	
+	/// Flag of the thread
+	ArrivalFlag& flag=
+	  arrivalFlags[threadId];
+	
+	flag.work.store(prevNWorkAssigned);
+	notifyParked(flag.work,flag.nParked);
 	
 	/// Wait that the master gives signal that work has been assigned
-	waitThatMasterSignalsNewWork(prevNWorkAssigned);
+	const WaitPhase phase=
+	  waitThatMasterSignalsNewWork(prevNWorkAssigned);
 	
 	// Cache synchronization, possibly useless
 	std::atomic_thread_fence(std::memory_order_acquire);
+	
+	if(useWaitStatistics)
+	  waitStatistics[threadId].account(phase,timeDiffInSec(takeTime(),workAssignmentInstant));
       }
     }
     
@@ -180,6 +780,17 @@ namespace ciccios
       
       poolIsStarted=true;
       
+      resources::waitStatistics.resize(nThreads);
+      prepareWorkProfile(nThreads);
+      resources::arrivalFlags=
+	std::vector<ArrivalFlag>(nThreads);
+      
+      setupAffinity(nThreads);
+      pinThread(masterThreadId);
+      
+      resources::backend.reset(makeBackend(backendName));
+      LOGGER<<"Backend: "<<resources::backend->name()<<endl;
+      
       if(useDetachedPool)
 	{
 	  LOGGER<<"Attached pool"<<endl;
@@ -194,6 +805,7 @@ namespace ciccios
       else
 	{
 	  LOGGER<<"Not attached pool"<<endl;
+	  
 #pragma omp parallel
 	  {
 	    /// Get current thread
@@ -210,59 +822,268 @@ namespace ciccios
     /// Starts a parallel section
     ///
     /// The object \a f must be callable, returning void and getting
-    /// an integer as a parameter, representing the thread id
+    /// an integer as a parameter, representing the thread id. If the
+    /// calling thread leads a team, the work is given to the team,
+    /// with the thread id being the rank in the team. If the calling
+    /// thread is executing another work, \a f is called only with
+    /// thread id 0 by the calling thread. Otherwise the work is run
+    /// through the current backend, on the first \a nParticipants
+    /// threads if the backend allows it, else on all threads: the
+    /// completion of the work is not necessarily waited before
+    /// returning. If the backend cannot start the work, the spin
+    /// backend is used from then on.
     template <typename F>
     INLINE_FUNCTION
-    void parallel(F&& f) ///< Function embedding the work
+    void parallel(F&& f,                                ///< Function embedding the work
+		  const int& nParticipants=nThreads)    ///< Number of threads needed, for the pool only
     {
+      // Nested parallelism: give the work to the team led by the thread
+      if(resources::currentTeam)
+	{
+	  resources::currentTeam->parallel(std::forward<F>(f));
+	  
+	  return;
+	}
+      
+      // Nested parallelism without a team: run the work serially
+      if(poolIsStarted and resources::isExecutingWork)
+	{
+	  f(masterThreadId);
+	  
+	  return;
+	}
+      
       if(not poolIsStarted)
-	poolStart(parallel<F>,std::forward<F>(f));
+	poolStart([&f,nParticipants]()
+		  {
+		    parallel(std::forward<F>(f),nParticipants);
+		  });
       else
 	{
+	  // The previous work must be completed before starting a new epoch
 	  waitThatAllWorkersWaitForWork();
 	  work=std::move(f);
+	  nWorksDispatched++;
 	  
-	  nThreadsWaitingForWork=0;
-	  nWorksAssigned.store(nWorksAssigned+1,std::memory_order_release);
+	  if(useWaitStatistics or useWorkProfiling)
+	    workAssignmentInstant=takeTime();
 	  
-	  work(masterThreadId);
+	  if(not resources::backend->dispatch(nParticipants))
+	    {
+	      LOGGER<<"The "<<resources::backend->name()<<" backend could not start "<<nParticipants<<" threads, switching to the spin backend"<<endl;
+	      resources::backend.reset(new SpinBackend);
+	      resources::backend->dispatch(nParticipants);
+	    }
+	  
+	  // The epoch is advanced only now that the work has been assigned
+	  resources::poolEpoch.fetch_add(1);
 	}
     }
     
-    /// Split a loop into \c nTrheads chunks, giving each chunk as a work for a corresponding thread
+    /// Chunk of the loop [beg,end) assigned to a thread, splitting it into \c nPieces equal parts
+    template <typename Size>           // Type for the range of the loop
+    INLINE_FUNCTION
+    std::pair<Size,Size> getStaticChunk(const Size& beg,     ///< Beginning of the loop
+					const Size& end,     ///< End of the loop
+					const int& threadId, ///< Thread asking for the chunk
+					const int& nPieces)  ///< Number of parts
+    {
+      /// Workload for each thread, taking into account the remainder
+      const Size threadLoad
+	{(end-beg+nPieces-1)/nPieces};
+      
+      /// Beginning of the chunk, if \c end is not smaller
+      const Size firstBunchBeg
+	{beg+threadLoad*threadId};
+      
+      /// Beginning of the chunk
+      const Size threadBeg
+	{std::min(end,firstBunchBeg)};
+      
+      /// End of the assignment for last bunch, if \c end is not smaller
+      const Size lastBunchEnd
+	{threadBeg+threadLoad};
+      
+      /// End of the chunk
+      const Size threadEnd
+	{std::min(end,lastBunchEnd)};
+      
+      return {threadBeg,threadEnd};
+    }
+    
+    /// Number of threads over which to split a loop of the given length and cost
+    ///
+    /// If only the chosen threads are started, as with the OpenMP
+    /// backend, each thread is given at least as much work as
+    /// the overhead of the dispatch. Otherwise all threads are woken
+    /// up anyway, so the loop is run either serially or on all
+    /// threads, whichever is faster. If the cost is not known, all
+    /// threads are used.
+    inline int chooseNPieces(const int64_t& length,          ///< Length of the loop
+			     const double& costPerIteration,   ///< Cost of each iteration
+			     const bool& canUseSubset)         ///< Only the chosen threads are started
+    {
+      /// Threads available
+      const int nAvailable=
+	getCurrentNThreads();
+      
+      if(costPerIteration<=0 or nAvailable==1)
+	return nAvailable;
+      
+      /// Number of threads for which the work per thread is worth the overhead
+      const double nWorthPieces=
+	length*costPerIteration/getDispatchOverhead();
+      
+      if(canUseSubset)
+	return std::max(1,(int)std::min((double)nAvailable,nWorthPieces));
+      
+      // The overhead plus the share of each thread must be shorter than the serial loop
+      if(nWorthPieces*(nAvailable-1)>nAvailable)
+	return nAvailable;
+      else
+	return 1;
+    }
+    
+    /// Run the iterations [beg,end) of a loop, giving back after each of them the memory taken from the scratch arena
     template <typename Size,           // Type for the range of the loop
 	      typename F>              // Type of the function
     INLINE_FUNCTION
-    void loopSplit(const Size& beg,  ///< Beginning of the loop
-		   const Size& end,  ///< End of the loop
-		   F&& f)            ///< Function to be called
-    {
-      parallel([beg,end,nPieces=nThreads,f](const int& threadId) mutable
-	       {
-		 /// Workload for each thread, taking into account the remainder
-		 const Size threadLoad
-		   {(end-beg+nPieces-1)/nPieces};
-		 
-		 /// Beginning of the chunk
-		 const Size threadBeg
-		   {threadLoad*threadId};
-		 
-		 /// End of the assignment for last bunch, if \c end is not smaller
-		 const Size lastBunchEnd
-		   {threadBeg+threadLoad};
-		 
-		 /// End of the chunk
-		 const Size threadEnd
-		   {std::min(end,lastBunchEnd)};
-		 
-		 for(Size i=threadBeg;i<threadEnd;i++)
-		   f(i);
-	       });
+    void runIterations(const Size& beg,                        ///< Beginning of the iterations
+		       const Size& end,                        ///< End of the iterations
+		       F& f,                                   ///< Function to be called
+		       const LoopSchedule::ChunkHook& onChunk) ///< Called before the iterations, if set
+    {
+      if(onChunk)
+	onChunk((int64_t)beg,(int64_t)end);
+      
+      /// Scope of the memory taken from the arena by the iterations
+      ScratchArenaScope arenaScope;
+      
+      for(Size i=beg;i<end;i++)
+	{
+	  f(i);
+	  arenaScope.rewind();
+	}
+    }
+    
+    /// Split a loop into chunks, giving each chunk as a work for a corresponding thread
+    ///
+    /// By default the loop is split into \c nThreads contiguous
+    /// chunks, otherwise according to \a schedule. If asked in the
+    /// schedule, and not disabled through the ADAPTIVE_LOOP_SPLIT
+    /// flag, the loop is run serially when its cost does not justify
+    /// the dispatch to all threads, or on a subset of threads if the
+    /// backend starts only the threads taking part to the work. The
+    /// cost per iteration is measured on the master thread and kept
+    /// per call site, unless provided in the schedule. Each thread
+    /// gives back after each iteration the memory taken from its
+    /// scratch arena, and calls the chunk hook of the schedule, if
+    /// any, with the boundaries of each chunk before running it.
+    template <typename Size,           // Type for the range of the loop
+	      typename F>              // Type of the function
+    INLINE_FUNCTION
+    void loopSplit(const Size& beg,                         ///< Beginning of the loop
+		   const Size& end,                         ///< End of the loop
+		   F&& f,                                   ///< Function to be called
+		   const LoopSchedule& schedule={})         ///< Scheduling of the iterations
+    {
+      /// Length of the loop
+      const int64_t length=
+	(int64_t)end-(int64_t)beg;
+      
+      /// Decide whether to adapt the number of threads, only for loops issued outside any work
+      const bool adaptive=
+	schedule.adaptive and useAdaptiveLoopSplit and not resources::isExecutingWork;
+      
+      /// Estimate of the cost of the loop, to be updated if the cost is not provided
+      LoopCostEstimate* estimate=
+	(adaptive and schedule.costPerIteration==0)?&costEstimateOf<std::decay_t<F>>():nullptr;
+      
+      /// Check whether the loop can be run on a subset of threads, if not issued to a team
+      const bool canUseSubset=
+	poolIsStarted and resources::backend->startsOnlyParticipants() and not resources::currentTeam;
+      
+      /// Number of threads to be used
+      const int nPieces=
+	adaptive?chooseNPieces(length,estimate?estimate->costPerIteration:schedule.costPerIteration,canUseSubset):getCurrentNThreads();
+      
+      if(nPieces==1)
+	{
+	  // Previous loops must be completed, as if the loop was dispatched
+	  waitThatAllWorkersWaitForWork();
+	  
+	  /// Takes note of starting moment
+	  const Instant start=
+	    takeTime();
+	  
+	  runIterations(beg,end,f,schedule.onChunk);
+	  
+	  if(estimate)
+	    estimate->update(timeDiffInSec(takeTime(),start),length);
+	}
+      else
+	if(schedule.kind==ScheduleKind::STATIC and schedule.alignment==1)
+	  parallel([beg,end,nPieces,estimate,onChunk=schedule.onChunk,f](const int& threadId) mutable
+		   {
+		     /// Chunk of the thread
+		     const std::pair<Size,Size> chunk=
+		       getStaticChunk(beg,end,threadId,nPieces);
+		     
+		     /// Takes note of starting moment
+		     const Instant start=
+		       takeTime();
+		     
+		     runIterations(chunk.first,chunk.second,f,onChunk);
+		     
+		     if(estimate and isMasterThread(threadId))
+		       estimate->update(timeDiffInSec(takeTime(),start),(int64_t)chunk.second-(int64_t)chunk.first);
+		   },nPieces);
+	else
+	  {
+	    /// Counter used by dynamic and guided loops, of the team if leading one
+	    std::atomic<int64_t>* counter=
+	      resources::currentTeam?
+	      &resources::currentTeam->getLoopChunkCounter():
+	      &resources::loopChunkCounter;
+	    
+	    // The counter can be reset only when no thread is using it
+	    if(schedule.kind==ScheduleKind::DYNAMIC or schedule.kind==ScheduleKind::GUIDED)
+	      {
+		waitThatAllWorkersWaitForWork();
+		counter->store(0,std::memory_order_relaxed);
+	      }
+	    
+	    parallel([offset=(int64_t)beg,length,nPieces,estimate,schedule,counter,f](const int& threadId) mutable
+		     {
+		       /// Number of iterations run by the thread
+		       int64_t nIterations=0;
+		       
+		       /// Takes note of starting moment
+		       const Instant start=
+			 takeTime();
+		       
+		       if(threadId<nPieces)
+			 forEachScheduledChunk(length,threadId,nPieces,schedule,counter,
+					       [offset,&f,&schedule,&nIterations](const int64_t& chunkBeg,const int64_t& chunkEnd)
+					       {
+						 runIterations(static_cast<Size>(offset+chunkBeg),static_cast<Size>(offset+chunkEnd),f,schedule.onChunk);
+						 
+						 nIterations+=chunkEnd-chunkBeg;
+					       });
+		       
+		       if(estimate and isMasterThread(threadId))
+			 estimate->update(timeDiffInSec(takeTime(),start),nIterations);
+		     },nPieces);
+	  }
     }
   }
   
 #else
   
+  /// Number of threads: only the master is present
+  [[ maybe_unused ]]
+  constexpr int nThreads=1;
+  
   namespace ThreadPool
   {
     INLINE_FUNCTION
@@ -271,19 +1092,64 @@ namespace ciccios
     }
     
     INLINE_FUNCTION
-    void waitForWork()
+    void waitWorksInFlight()
+    {
+    }
+    
+    INLINE_FUNCTION
+    int64_t getPoolEpoch()
+    {
+      return 0;
+    }
+    
+    INLINE_FUNCTION
+    int64_t getCompletedPoolEpoch()
     {
+      return 0;
+    }
+    
+    INLINE_FUNCTION
+    void waitForWork(const int& threadId)
+    {
+    }
+    
+    INLINE_FUNCTION
+    bool canDispatchWork()
+    {
+      return false;
+    }
+    
+    INLINE_FUNCTION
+    int getCurrentNThreads()
+    {
+      return 1;
+    }
+    
+    INLINE_FUNCTION
+    bool isInsideWork()
+    {
+      return false;
     }
     
     template <typename Size,           // Type for the range of the loop
 	      typename F>              // Type of the function
     INLINE_FUNCTION
-    void loopSplit(const Size& beg,  ///< Beginning of the loop
-		   const Size& end,  ///< End of the loop
-		   F&& f)            ///< Function to be called
+    void loopSplit(const Size& beg,                         ///< Beginning of the loop
+		   const Size& end,                         ///< End of the loop
+		   F&& f,                                   ///< Function to be called
+		   const LoopSchedule& schedule={})         ///< Scheduling, only the chunk hook is relevant without threads
     {
+      if(schedule.onChunk)
+	schedule.onChunk((int64_t)beg,(int64_t)end);
+      
+      /// Scope of the memory taken from the arena by the iterations
+      ScratchArenaScope arenaScope;
+      
       for(Size i=beg;i<end;i++)
-	f(i);
+	{
+	  f(i);
+	  arenaScope.rewind();
+	}
     }
     
     template <typename F,
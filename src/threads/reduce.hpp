@@ -0,0 +1,135 @@
+#ifndef _REDUCE_HPP
+#define _REDUCE_HPP
+
+/// \file reduce.hpp
+///
+/// \brief Implements the reduction of a loop across threads
+///
+/// Each thread reduces its chunk of the loop into a private partial,
+/// padded to a cache line to avoid false sharing. The partials are
+/// then combined pairwise in a binary tree, so that the order of the
+/// operations does not depend on the timing of the threads. If the
+/// partial is a Simd, its lanes are finally reduced too.
+
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+#include <vector>
+
+#include <base/metaProgramming.hpp>
+#include <dataTypes/SIMD.hpp>
+#include <threads/pool.hpp>
+
+namespace ciccios
+{
+  namespace ThreadPool
+  {
+    /// Partial result of a thread, padded to fill a cache line
+    template <typename T>
+    struct alignas(CACHE_LINE_SIZE) PaddedPartial
+    {
+      /// Stored value
+      T value;
+    };
+    
+    /// Combine in a binary tree the partials, leaving the result in the first
+    template <typename T,
+	      typename C>
+    void treeCombine(std::vector<PaddedPartial<T>>& partials, ///< Partials to combine
+		     C&& combine)                             ///< Binary operation
+    {
+      /// Number of partials
+      const int n=
+	partials.size();
+      
+      for(int stride=1;stride<n;stride*=2)
+	for(int i=0;i+stride<n;i+=2*stride)
+	  partials[i].value=
+	    combine(partials[i].value,partials[i+stride].value);
+    }
+    
+    /// Reduce the lanes of the result, if it is a Simd
+    template <typename T,
+	      typename C,
+	      ENABLE_THIS_TEMPLATE_IF(FundOfSimd<T>::isSimd)>
+    auto reduceLanesIfSimd(const T& t,
+			   C&& combine)
+    {
+      return
+	simdHorizontalReduce<typename FundOfSimd<T>::type>(t,std::forward<C>(combine));
+    }
+    
+    /// Returns the result as it is, if not a Simd
+    template <typename T,
+	      typename C,
+	      ENABLE_THIS_TEMPLATE_IF(not FundOfSimd<T>::isSimd)>
+    const T& reduceLanesIfSimd(const T& t,
+			       C&& /*combine*/)
+    {
+      return
+	t;
+    }
+    
+    /// Reduce a loop across all threads
+    ///
+    /// Computes combine(...combine(init,f(beg))...,f(end-1)), where
+    /// \a init must be the neutral element of \a combine, such as
+    /// zero for a sum, as each thread starts from it. The operation
+    /// must be associative, and if the partial type is \c Simd<Fund>,
+    /// it must accept also pairs of \c Fund, in which case the lanes
+    /// are reduced and a \c Fund is returned.
+    template <typename Size,           // Type for the range of the loop
+	      typename T,              // Type of the partial result
+	      typename F,              // Type of the function
+	      typename C>              // Type of the binary operation
+    auto loopReduce(const Size& beg,   ///< Beginning of the loop
+		    const Size& end,   ///< End of the loop
+		    const T& init,     ///< Neutral element
+		    F&& f,             ///< Function returning the contribution of each iteration
+		    C&& combine)       ///< Binary operation
+    {
+      /// Number of threads taking part to the reduction
+      const int nPieces=
+	getCurrentNThreads();
+      
+      /// Partial result of each thread
+      std::vector<PaddedPartial<T>> partials(nPieces);
+      
+#ifdef USE_THREADS
+      parallel([beg,end,nPieces,&init,&f,&combine,&partials](const int& threadId)
+	       {
+		 /// Chunk of the thread
+		 const std::pair<Size,Size> chunk=
+		   getStaticChunk(beg,end,threadId,nPieces);
+		 
+		 /// Partial of the thread, kept local during the loop
+		 T partial=
+		   init;
+		 
+		 for(Size i=chunk.first;i<chunk.second;i++)
+		   partial=combine(partial,f(i));
+		 
+		 partials[threadId].value=
+		   partial;
+	       });
+      
+      // Partials are ready only when all threads have finished
+      waitThatAllWorkersWaitForWork();
+#else
+      partials[0].value=
+	init;
+      
+      for(Size i=beg;i<end;i++)
+	partials[0].value=combine(partials[0].value,f(i));
+#endif
+      
+      treeCombine(partials,combine);
+      
+      return
+	reduceLanesIfSimd(partials[0].value,combine);
+    }
+  }
+}
+
+#endif
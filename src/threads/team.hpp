@@ -0,0 +1,248 @@
+#ifndef _TEAM_HPP
+#define _TEAM_HPP
+
+/// \file team.hpp
+///
+/// \brief Persistent parallel regions
+///
+/// A region is dispatched to the pool once, and all threads run the
+/// same function, getting a \c Team through which they can split
+/// loops and synchronize with a barrier. This avoids the dispatch and
+/// join of the pool for each loop, which dominates iterative
+/// algorithms on small volumes.
+///
+/// The pool can also be split into teams of threads, each led by one
+/// thread which can dispatch work only to its team, so that
+/// independent kernels can run concurrently.
+
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+#include <memory>
+#include <vector>
+
+#include <base/debug.hpp>
+#include <threads/barrier.hpp>
+#include <threads/pool.hpp>
+
+namespace ciccios
+{
+  namespace ThreadPool
+  {
+    /// Team of threads running a parallel region
+    class Team
+    {
+      /// Thread id inside the team
+      const int threadId;
+      
+      /// Number of threads in the team
+      const int nThreadsInTeam;
+      
+      /// Barrier shared by the team
+      DisseminationBarrier& teamBarrier;
+      
+    public:
+      
+      /// Create the team view for the given thread
+      Team(const int& threadId,
+	   const int& nThreadsInTeam,
+	   DisseminationBarrier& teamBarrier) :
+	threadId(threadId),
+	nThreadsInTeam(nThreadsInTeam),
+	teamBarrier(teamBarrier)
+      {
+      }
+      
+      /// Thread id inside the team
+      int getThreadId()
+	const
+      {
+	return threadId;
+      }
+      
+      /// Number of threads in the team
+      int getNThreads()
+	const
+      {
+	return nThreadsInTeam;
+      }
+      
+      /// Check if this is the master of the team
+      bool isMaster()
+	const
+      {
+	return threadId==0;
+      }
+      
+      /// Wait that all threads of the team reach the barrier
+      void barrier()
+      {
+	teamBarrier.wait(threadId);
+      }
+      
+      /// Run the part of the loop assigned to this thread
+      ///
+      /// No barrier is implied at the end: call \c barrier before
+      /// using the results of other threads. Only static schedules
+      /// are supported, as the assignment of each thread must be
+      /// known without communication.
+      template <typename Size,           // Type for the range of the loop
+		typename F>              // Type of the function
+      void loop(const Size& beg,                         ///< Beginning of the loop
+		const Size& end,                         ///< End of the loop
+		F&& f,                                   ///< Function to be called
+		const LoopSchedule& schedule={})         ///< Scheduling of the iterations
+	const
+      {
+	if(schedule.kind!=ScheduleKind::STATIC and schedule.kind!=ScheduleKind::STATIC_CHUNK)
+	  CRASHER<<"Only static schedules are supported inside a region"<<endl;
+	
+	/// Beginning of the loop
+	const int64_t offset=
+	  (int64_t)beg;
+	
+	forEachScheduledChunk((int64_t)end-offset,threadId,nThreadsInTeam,schedule,nullptr,
+			      [offset,&f,&schedule](const int64_t& chunkBeg,const int64_t& chunkEnd)
+			      {
+				if(schedule.onChunk)
+				  schedule.onChunk(offset+chunkBeg,offset+chunkEnd);
+				
+				for(int64_t i=chunkBeg;i<chunkEnd;i++)
+				  f(static_cast<Size>(offset+i));
+			      });
+      }
+    };
+    
+    /// Run \a f in a parallel region on all threads
+    ///
+    /// The object \a f must be callable with a \c Team&, and is run
+    /// once per thread. Differently from \c parallel, this returns
+    /// only when all threads have completed the region.
+    ///
+    /// If the calling thread leads a team, the region is run on the
+    /// team, if it is executing another work the region is run by the
+    /// calling thread alone.
+    template <typename F>
+    void region(F&& f) ///< Function run by each thread
+    {
+      /// Number of threads running the region
+      const int nThreadsInRegion=
+	getCurrentNThreads();
+      
+      /// Barrier of the team
+      DisseminationBarrier teamBarrier(nThreadsInRegion);
+      
+#ifdef USE_THREADS
+      parallel([&teamBarrier,nThreadsInRegion,&f](const int& threadId)
+	       {
+		 /// Team seen by the thread
+		 Team team(threadId,nThreadsInRegion,teamBarrier);
+		 
+		 f(team);
+	       });
+      
+      waitThatAllWorkersWaitForWork();
+#else
+      /// Team made only of the master
+      Team team(0,1,teamBarrier);
+      
+      f(team);
+#endif
+    }
+    
+    /// Split the pool into teams of consecutive threads, and run \a f on the leader of each team
+    ///
+    /// The object \a f is called with the id of the team. Inside it,
+    /// \c parallel, \c loopSplit, \c loopReduce and \c region run on
+    /// the threads of the team only. Threads exceeding the sum of the
+    /// sizes stay idle. With a compact affinity, teams as large as a
+    /// socket are placed each on its own socket. Returns when all
+    /// teams have completed.
+    template <typename F>
+    void runTeams(const std::vector<int>& teamSizes, ///< Number of threads of each team
+		  F&& f)                             ///< Function run by the leader of each team
+    {
+      /// Number of teams
+      const int nTeams=
+	teamSizes.size();
+      
+#ifdef USE_THREADS
+      if(resources::currentTeam or not canDispatchWork())
+	CRASHER<<"Teams can only be created by the master, outside any work"<<endl;
+      
+      /// First thread of each team
+      std::vector<int> firstThreadOfTeam;
+      
+      /// Dispatcher of each team
+      std::vector<std::unique_ptr<TeamDispatcher>> teams;
+      
+      /// Number of threads assigned to teams
+      int nAssignedThreads=0;
+      for(const int& teamSize : teamSizes)
+	{
+	  if(teamSize<=0)
+	    CRASHER<<"Teams must have at least one thread, asked for "<<teamSize<<endl;
+	  
+	  firstThreadOfTeam.push_back(nAssignedThreads);
+	  teams.emplace_back(new TeamDispatcher(teamSize));
+	  nAssignedThreads+=teamSize;
+	}
+      
+      if(nAssignedThreads>nThreads)
+	CRASHER<<"Asked for "<<nAssignedThreads<<" threads in teams, only "<<nThreads<<" available"<<endl;
+      
+      parallel([&](const int& threadId)
+	       {
+		 /// Team of the thread
+		 int iTeam=0;
+		 while(iTeam<nTeams and threadId>=firstThreadOfTeam[iTeam]+teamSizes[iTeam])
+		   iTeam++;
+		 
+		 if(iTeam<nTeams)
+		   {
+		     /// Rank of the thread inside the team
+		     const int rank=
+		       threadId-firstThreadOfTeam[iTeam];
+		     
+		     /// Dispatcher of the team
+		     TeamDispatcher& team=
+		       *teams[iTeam];
+		     
+		     if(rank==0)
+		       {
+			 resources::currentTeam=&team;
+			 
+			 f(iTeam);
+			 
+			 team.stop();
+			 resources::currentTeam=nullptr;
+		       }
+		     else
+		       team.memberLoop(rank);
+		   }
+	       });
+      
+      waitThatAllWorkersWaitForWork();
+#else
+      for(int iTeam=0;iTeam<nTeams;iTeam++)
+	f(iTeam);
+#endif
+    }
+    
+    /// Split the pool into the given number of teams of similar size
+    template <typename F>
+    void runTeams(const int& nTeams, ///< Number of teams
+		  F&& f)             ///< Function run by the leader of each team
+    {
+      /// Number of threads of each team
+      std::vector<int> teamSizes(nTeams);
+      for(int iTeam=0;iTeam<nTeams;iTeam++)
+	teamSizes[iTeam]=nThreads/nTeams+(iTeam<nThreads%nTeams);
+      
+      runTeams(teamSizes,std::forward<F>(f));
+    }
+  }
+}
+
+#endif
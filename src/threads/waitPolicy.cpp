@@ -0,0 +1,10 @@
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+/// \file waitPolicy.cpp
+///
+/// \brief Defines the parameters of the waiting policy
+
+#define EXTERN_WAIT_POLICY
+# include "threads/waitPolicy.hpp"
@@ -0,0 +1,146 @@
+#ifndef _WAIT_POLICY_HPP
+#define _WAIT_POLICY_HPP
+
+/// \file waitPolicy.hpp
+///
+/// \brief Implements the hybrid spin-then-park waiting of threads
+///
+/// A thread waiting for a condition first spins issuing a pause
+/// instruction, then yields the processor for some iterations, and
+/// finally parks itself on a futex, to be awaken by the thread
+/// changing the condition. The number of spin and yield iterations
+/// can be tuned through environment flags.
+
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+#ifndef DISABLE_X86_INTRINSICS
+# include <immintrin.h>
+#endif
+
+#include <atomic>
+#include <climits>
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <base/inliner.hpp>
+
+#ifndef EXTERN_WAIT_POLICY
+# define EXTERN_WAIT_POLICY extern
+#endif
+
+namespace ciccios
+{
+  namespace ThreadPool
+  {
+    /// Number of iterations spent spinning before yielding
+    EXTERN_WAIT_POLICY int nWaitSpinIterations;
+    
+    /// Number of iterations spent yielding before parking
+    EXTERN_WAIT_POLICY int nWaitYieldIterations;
+    
+    /// Phase in which the waiting ended
+    enum class WaitPhase{SPIN,YIELD,PARK};
+    
+    /// Hint the processor that we are in a spin loop
+    INLINE_FUNCTION
+    void cpuRelax()
+    {
+#ifndef DISABLE_X86_INTRINSICS
+      _mm_pause();
+#endif
+    }
+    
+    /// Park the calling thread until \c word is changed from \c val, or a spurious wake up
+    INLINE_FUNCTION
+    void futexWait(std::atomic<int>& word,
+		   const int& val)
+    {
+      syscall(SYS_futex,reinterpret_cast<int*>(&word),FUTEX_WAIT_PRIVATE,val,nullptr,nullptr,0);
+    }
+    
+    /// Wake all threads parked on \c word
+    INLINE_FUNCTION
+    void futexWakeAll(std::atomic<int>& word)
+    {
+      syscall(SYS_futex,reinterpret_cast<int*>(&word),FUTEX_WAKE_PRIVATE,INT_MAX,nullptr,nullptr,0);
+    }
+    
+    /// Wait until \c isDone returns true
+    ///
+    /// The condition must be changed only together with \c word,
+    /// which is the variable on which the thread is parked, and the
+    /// changing thread must call \c notifyParked afterwards. Returns
+    /// the phase in which the waiting ended.
+    template <typename F>
+    WaitPhase waitUntil(std::atomic<int>& word,      ///< Word on which to park
+			std::atomic<int>& nParked,   ///< Number of threads parked on the word
+			F&& isDone)                  ///< Condition to be waited
+    {
+      for(int i=0;i<nWaitSpinIterations;i++)
+	if(isDone())
+	  return WaitPhase::SPIN;
+	else
+	  cpuRelax();
+      
+      for(int i=0;i<nWaitYieldIterations;i++)
+	if(isDone())
+	  return WaitPhase::YIELD;
+	else
+	  sched_yield();
+      
+      while(not isDone())
+	{
+	  /// Value seen before parking, futex returns immediately if changed
+	  const int val=
+	    word.load();
+	  
+	  nParked.fetch_add(1);
+	  
+	  if(not isDone())
+	    futexWait(word,val);
+	  
+	  nParked.fetch_sub(1);
+	}
+      
+      return WaitPhase::PARK;
+    }
+    
+    /// Wait until \c isDone returns true, spinning and then yielding, without ever parking
+    ///
+    /// To be used when the wait is expected to be short, and no
+    /// futex word is associated to the condition
+    template <typename F>
+    WaitPhase waitWithoutParkingUntil(F&& isDone) ///< Condition to be waited
+    {
+      for(int i=0;i<nWaitSpinIterations;i++)
+	if(isDone())
+	  return WaitPhase::SPIN;
+	else
+	  cpuRelax();
+      
+      while(not isDone())
+	sched_yield();
+      
+      return WaitPhase::YIELD;
+    }
+    
+    /// Wake up the threads parked on \c word, if any
+    ///
+    /// Must be called after changing \c word
+    INLINE_FUNCTION
+    void notifyParked(std::atomic<int>& word,
+		      std::atomic<int>& nParked)
+    {
+      if(nParked.load()>0)
+	futexWakeAll(word);
+    }
+  }
+}
+
+#undef EXTERN_WAIT_POLICY
+
+#endif
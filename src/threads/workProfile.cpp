@@ -0,0 +1,190 @@
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+/// \file workProfile.cpp
+///
+/// \brief Implements the summary and export of the timings of the works
+
+#define EXTERN_WORK_PROFILE
+# include "threads/workProfile.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+#include <base/logger.hpp>
+#include <base/ranks.hpp>
+#include <threads/pool.hpp>
+
+namespace ciccios
+{
+  namespace ThreadPool
+  {
+#ifdef USE_THREADS
+    void prepareWorkProfile(const int& nThreads)
+    {
+      resources::workRecords.resize(nThreads);
+      
+      if(useWorkProfiling)
+	for(WorkRecordBuffer& buffer : resources::workRecords)
+	  buffer.prepare(nMaxProfiledWorks);
+    }
+    
+    /// Timings of a work summed over all threads
+    struct WorkSummary
+    {
+      /// Moment at which the work has been assigned
+      Instant dispatch;
+      
+      /// Moment at which the last thread completed the work
+      Instant end;
+      
+      /// Number of threads which recorded the work
+      int nThreadsRecorded;
+      
+      /// Time spent by all threads executing the work
+      double totBusy;
+      
+      /// Maximal time spent by a thread executing the work
+      double maxBusy;
+    };
+    
+    /// Export the records to the file specified through the flag
+    void exportWorkProfile()
+    {
+      /// Name of the file
+      const std::string path=
+	workProfileFile+"."+std::to_string(rank());
+      
+      /// File where to write
+      std::ofstream out(path);
+      
+      if(not out.good())
+	CRASHER<<"Unable to open "<<path<<" to export the profile of the works"<<endl;
+      
+      /// Reference moment, the first assignment recorded
+      Instant origin=
+	Instant::max();
+      
+      for(const WorkRecordBuffer& buffer : resources::workRecords)
+	if(buffer.records.size())
+	  origin=std::min(origin,buffer.records.front().dispatch);
+      
+      out<<"# work thread dispatch begin end (seconds)"<<std::endl;
+      for(int threadId=0;threadId<nThreads;threadId++)
+	for(const WorkRecord& r : resources::workRecords[threadId].records)
+	  out<<r.iWork<<" "<<threadId<<" "<<
+	    timeDiffInSec(r.dispatch,origin)<<" "<<
+	    timeDiffInSec(r.begin,origin)<<" "<<
+	    timeDiffInSec(r.end,origin)<<std::endl;
+      
+      LOGGER<<"Profile of the works exported to "<<path<<endl;
+    }
+    
+    void printWorkProfile()
+    {
+      if(not useWorkProfiling)
+	return;
+      
+      /// Summary of each work, indexed by the work
+      std::map<int,WorkSummary> works;
+      
+      for(int threadId=0;threadId<nThreads;threadId++)
+	for(const WorkRecord& r : resources::workRecords[threadId].records)
+	  {
+	    /// Busy time of the thread
+	    const double busy=
+	      timeDiffInSec(r.end,r.begin);
+	    
+	    /// Summary of the work, created at first usage
+	    auto ins=
+	      works.try_emplace(r.iWork,WorkSummary{r.dispatch,r.end,0,0.0,0.0});
+	    
+	    WorkSummary& w=
+	      ins.first->second;
+	    
+	    w.end=std::max(w.end,r.end);
+	    w.nThreadsRecorded++;
+	    w.totBusy+=busy;
+	    w.maxBusy=std::max(w.maxBusy,busy);
+	  }
+      
+      /// Number of works recorded by all threads
+      int64_t nWorks=0;
+      
+      /// Total time elapsed between assignment and completion of all works
+      double totWall=0;
+      
+      /// Total time spent by the threads executing the works
+      double totBusy=0;
+      
+      /// Sum over works of the maximal time spent by a thread
+      double totMaxBusy=0;
+      
+      for(const auto& it : works)
+	{
+	  const WorkSummary& w=
+	    it.second;
+	  
+	  if(w.nThreadsRecorded==nThreads)
+	    {
+	      nWorks++;
+	      totWall+=timeDiffInSec(w.end,w.dispatch);
+	      totBusy+=w.totBusy;
+	      totMaxBusy+=w.maxBusy;
+	    }
+	}
+      
+      LOGGER<<"Profile of the works executed by the pool: "<<nWorks<<" works recorded by all threads"<<endl;
+      
+      if(nWorks==0)
+	return;
+      
+      /// Sum over works of the average time spent by a thread
+      const double totAvgBusy=
+	totBusy/nThreads;
+      
+      LOGGER<<" wall time: "<<totWall<<" s, max thread time: "<<totMaxBusy<<" s, average thread time: "<<totAvgBusy<<" s"<<endl;
+      LOGGER<<" imbalance: "<<(totAvgBusy>0?(totMaxBusy/totAvgBusy-1)*100:0)<<" %, idle fraction: "<<1-totBusy/(nThreads*totWall)<<endl;
+      
+      for(int threadId=0;threadId<nThreads;threadId++)
+	{
+	  /// Buffer of the thread
+	  const WorkRecordBuffer& buffer=
+	    resources::workRecords[threadId];
+	  
+	  /// Time spent executing the works
+	  double busy=0;
+	  
+	  /// Total dispatch latency
+	  double totLatency=0;
+	  
+	  /// Maximal dispatch latency
+	  double maxLatency=0;
+	  
+	  for(const WorkRecord& r : buffer.records)
+	    if(works[r.iWork].nThreadsRecorded==nThreads)
+	      {
+		/// Time elapsed between the assignment and the beginning of the work
+		const double latency=
+		  timeDiffInSec(r.begin,r.dispatch);
+		
+		busy+=timeDiffInSec(r.end,r.begin);
+		totLatency+=latency;
+		maxLatency=std::max(maxLatency,latency);
+	      }
+	  
+	  LOGGER<<" thread "<<threadId<<": busy "<<busy<<" s, idle fraction: "<<1-busy/totWall<<
+	    ", dispatch latency average: "<<totLatency/nWorks*1e6<<" us, max: "<<maxLatency*1e6<<" us";
+	  if(buffer.nDropped)
+	    LOGGER<<", "<<buffer.nDropped<<" works not recorded";
+	  LOGGER<<endl;
+	}
+      
+      if(workProfileFile!="")
+	exportWorkProfile();
+    }
+#endif
+  }
+}
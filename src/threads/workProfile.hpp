@@ -0,0 +1,120 @@
+#ifndef _WORK_PROFILE_HPP
+#define _WORK_PROFILE_HPP
+
+/// \file workProfile.hpp
+///
+/// \brief Collects the time spent by each thread executing the works of the pool
+///
+/// When enabled through the WORK_PROFILE flag, each thread takes
+/// note of the moment at which each work has been assigned, and of
+/// the beginning and end of its own execution. Records are stored
+/// in a buffer owned by the thread, allocated at the start of the
+/// pool, so that no lock nor allocation is needed. When the pool is
+/// stopped, a summary of the dispatch latency, load imbalance and
+/// idle fraction is printed, and the records can be exported to a
+/// file.
+///
+/// Only the works dispatched to the whole pool are recorded. The
+/// works that a team leader dispatches to its team run inside the
+/// pool work issued by \c runTeams, so their time is accounted to
+/// it, including the time the members wait for their leader.
+
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <base/debug.hpp>
+#include <base/inliner.hpp>
+#include <threads/loopSchedule.hpp>
+
+#ifndef EXTERN_WORK_PROFILE
+# define EXTERN_WORK_PROFILE extern
+#endif
+
+namespace ciccios
+{
+  namespace ThreadPool
+  {
+    /// Take note of the timings of the works executed by each thread
+    EXTERN_WORK_PROFILE bool useWorkProfiling;
+    
+    /// Maximal number of works recorded by each thread
+    EXTERN_WORK_PROFILE int nMaxProfiledWorks;
+    
+    /// File where to export the records, suffixed with the rank, not exported if empty
+    EXTERN_WORK_PROFILE std::string workProfileFile;
+    
+    /// Timings of a work executed by a thread
+    struct WorkRecord
+    {
+      /// Index of the work
+      int iWork;
+      
+      /// Moment at which the work has been assigned
+      Instant dispatch;
+      
+      /// Moment at which the thread started the work
+      Instant begin;
+      
+      /// Moment at which the thread completed the work
+      Instant end;
+    };
+    
+    /// Records of the works executed by a thread, written only by the thread itself
+    struct alignas(CACHE_LINE_SIZE) WorkRecordBuffer
+    {
+      /// Records, never exceeding the reserved capacity
+      std::vector<WorkRecord> records;
+      
+      /// Number of records discarded because the buffer was full
+      int64_t nDropped;
+      
+      /// Starts empty, with no room for records
+      WorkRecordBuffer() :
+	nDropped(0)
+      {
+      }
+      
+      /// Empty the buffer and reserve the given number of records
+      void prepare(const int& capacity)
+      {
+	records.clear();
+	records.reserve(capacity);
+	nDropped=0;
+      }
+      
+      /// Add a record, or count it as dropped if the buffer is full
+      INLINE_FUNCTION
+      void add(const WorkRecord& record)
+      {
+	if(records.size()<records.capacity())
+	  records.push_back(record);
+	else
+	  nDropped++;
+      }
+    };
+    
+    namespace resources
+    {
+      /// Records of each thread
+      EXTERN_WORK_PROFILE std::vector<WorkRecordBuffer> workRecords;
+    }
+    
+    /// Allocates the buffers of the records, to be called at the start of the pool
+    void prepareWorkProfile(const int& nThreads);
+    
+    /// Prints the summary of the records, and export them if asked
+    ///
+    /// Only the works recorded by all threads are considered. Must be
+    /// called when no work is being executed.
+    void printWorkProfile();
+  }
+}
+
+#undef EXTERN_WORK_PROFILE
+
+#endif
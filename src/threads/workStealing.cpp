@@ -0,0 +1,103 @@
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+/// \file workStealing.cpp
+///
+/// \brief Implements the work-stealing scheduler loop
+
+#define EXTERN_WORK_STEALING
+# include "threads/workStealing.hpp"
+
+namespace ciccios
+{
+  namespace ThreadPool
+  {
+    WorkStealingScheduler::WorkStealingScheduler(const int& nThreads) :
+      deques(nThreads),
+      nPendingTasks(0),
+      nStolenTasks(0)
+    {
+    }
+    
+    void WorkStealingScheduler::prepare(const Task& root)
+    {
+      nPendingTasks.store(1,std::memory_order_relaxed);
+      
+      if(not deques[masterThreadId].push(root))
+	CRASHER<<"Unable to push the root task"<<endl;
+    }
+    
+    void WorkStealingScheduler::spawn(const int& threadId,
+				      const Task& task)
+    {
+      nPendingTasks.fetch_add(1,std::memory_order_relaxed);
+      
+      // If the queue is full, run the task immediately
+      if(not deques[threadId].push(task))
+	{
+	  /// Context of the task
+	  TaskContext ctx{threadId,task.kernel};
+	  
+	  (*task.kernel)(ctx,task.beg,task.end);
+	  
+	  nPendingTasks.fetch_sub(1,std::memory_order_release);
+	}
+    }
+    
+    bool WorkStealingScheduler::getTask(const int& threadId,
+					uint64_t& seed,
+					Task& task)
+    {
+      if(deques[threadId].pop(task))
+	return true;
+      
+      /// Number of queues
+      const int nDeques=
+	deques.size();
+      
+      // Try a round of steals starting from a random victim
+      for(int iTry=0;iTry<nDeques;iTry++)
+	{
+	  // Xorshift random generator
+	  seed^=seed<<13;
+	  seed^=seed>>7;
+	  seed^=seed<<17;
+	  
+	  /// Victim to steal from
+	  const int victim=
+	    seed%nDeques;
+	  
+	  if(victim!=threadId and deques[victim].steal(task))
+	    {
+	      nStolenTasks.fetch_add(1,std::memory_order_relaxed);
+	      
+	      return true;
+	    }
+	}
+      
+      return false;
+    }
+    
+    void WorkStealingScheduler::workerLoop(const int& threadId)
+    {
+      /// Seed of the victim selection, different for each thread
+      uint64_t seed=
+	0x9E3779B97F4A7C15ULL*(threadId+1);
+      
+      /// Task to be executed
+      Task task;
+      
+      while(nPendingTasks.load(std::memory_order_acquire)>0)
+	if(getTask(threadId,seed,task))
+	  {
+	    /// Context of the task
+	    TaskContext ctx{threadId,task.kernel};
+	    
+	    (*task.kernel)(ctx,task.beg,task.end);
+	    
+	    nPendingTasks.fetch_sub(1,std::memory_order_release);
+	  }
+    }
+  }
+}
@@ -0,0 +1,392 @@
+#ifndef _WORK_STEALING_HPP
+#define _WORK_STEALING_HPP
+
+/// \file workStealing.hpp
+///
+/// \brief Implements a work-stealing scheduler on top of the pool
+///
+/// Each thread of the pool owns a double-ended queue of tasks. The
+/// owner pushes and pops tasks at the bottom, while idle threads
+/// steal from the top of the queue of a randomly chosen victim. A
+/// task is a range of iterations of a kernel, and the kernel can
+/// spawn subtasks on subranges, which are then available to be stolen
+/// by idle threads.
+
+#ifdef HAVE_CONFIG_H
+# include "config.hpp"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <threads/pool.hpp>
+
+#ifndef EXTERN_WORK_STEALING
+# define EXTERN_WORK_STEALING extern
+#endif
+
+namespace ciccios
+{
+  namespace ThreadPool
+  {
+    struct TaskContext;
+    
+    /// Type-erased kernel executed by a task
+    struct TaskKernel
+    {
+      /// Function running the kernel on the range [beg,end)
+      void (*fun)(const void* obj,TaskContext& ctx,const int64_t beg,const int64_t end);
+      
+      /// Object embedding the kernel
+      const void* obj;
+      
+      /// Run on the given range
+      INLINE_FUNCTION
+      void operator()(TaskContext& ctx,const int64_t beg,const int64_t end) const
+      {
+	fun(obj,ctx,beg,end);
+      }
+    };
+    
+    /// Task to be executed: a kernel and a range
+    struct Task
+    {
+      /// Kernel to be run
+      const TaskKernel* kernel;
+      
+      /// Beginning of the range
+      int64_t beg;
+      
+      /// End of the range
+      int64_t end;
+    };
+    
+    /// Double-ended queue of tasks, owned by a single thread
+    ///
+    /// Implements the Chase-Lev lock-free algorithm on a fixed size
+    /// circular buffer, in the formulation of Le et al. (PPoPP 2013)
+    class alignas(CACHE_LINE_SIZE) WorkStealingDeque
+    {
+      /// Slot of the buffer, each field is atomic to allow concurrent read from thieves
+      struct Slot
+      {
+	/// Kernel
+	std::atomic<const TaskKernel*> kernel;
+	
+	/// Beginning of the range
+	std::atomic<int64_t> beg;
+	
+	/// End of the range
+	std::atomic<int64_t> end;
+      };
+      
+      /// Log2 of the capacity
+      static constexpr int LOG2_CAPACITY=
+	10;
+      
+      /// Maximal number of tasks in the queue
+      static constexpr int64_t CAPACITY=
+	1<<LOG2_CAPACITY;
+      
+      /// Top of the queue, where thieves steal
+      alignas(CACHE_LINE_SIZE) std::atomic<int64_t> top;
+      
+      /// Bottom of the queue, where the owner pushes and pops
+      alignas(CACHE_LINE_SIZE) std::atomic<int64_t> bottom;
+      
+      /// Circular buffer
+      alignas(CACHE_LINE_SIZE) Slot buffer[CAPACITY];
+      
+      /// Write a task in a slot
+      void writeSlot(const int64_t i,
+		     const Task& task)
+      {
+	/// Slot to be written
+	Slot& s=buffer[i&(CAPACITY-1)];
+	
+	s.kernel.store(task.kernel,std::memory_order_relaxed);
+	s.beg.store(task.beg,std::memory_order_relaxed);
+	s.end.store(task.end,std::memory_order_relaxed);
+      }
+      
+      /// Read a task from a slot
+      Task readSlot(const int64_t i)
+	const
+      {
+	/// Slot to be read
+	const Slot& s=buffer[i&(CAPACITY-1)];
+	
+	return {s.kernel.load(std::memory_order_relaxed),
+		s.beg.load(std::memory_order_relaxed),
+		s.end.load(std::memory_order_relaxed)};
+      }
+    
+    public:
+      
+      /// Creates an empty queue
+      WorkStealingDeque() :
+	top(0),
+	bottom(0)
+      {
+      }
+      
+      /// Push a task at the bottom, returns false if the queue is full
+      ///
+      /// Only the owner can call this
+      bool push(const Task& task)
+      {
+	/// Current bottom
+	const int64_t b=
+	  bottom.load(std::memory_order_relaxed);
+	
+	/// Current top
+	const int64_t t=
+	  top.load(std::memory_order_acquire);
+	
+	if(b-t>=CAPACITY)
+	  return false;
+	
+	writeSlot(b,task);
+	std::atomic_thread_fence(std::memory_order_release);
+	bottom.store(b+1,std::memory_order_relaxed);
+	
+	return true;
+      }
+      
+      /// Pop a task from the bottom, returns false if the queue is empty
+      ///
+      /// Only the owner can call this
+      bool pop(Task& task)
+      {
+	/// Bottom after the pop
+	const int64_t b=
+	  bottom.load(std::memory_order_relaxed)-1;
+	
+	bottom.store(b,std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	
+	/// Current top
+	int64_t t=
+	  top.load(std::memory_order_relaxed);
+	
+	/// Result
+	bool res=
+	  (t<=b);
+	
+	if(res)
+	  {
+	    task=readSlot(b);
+	    
+	    // Last element: compete with thieves
+	    if(t==b)
+	      {
+		res=
+		  top.compare_exchange_strong(t,t+1,std::memory_order_seq_cst,std::memory_order_relaxed);
+		bottom.store(b+1,std::memory_order_relaxed);
+	      }
+	  }
+	else
+	  bottom.store(b+1,std::memory_order_relaxed);
+	
+	return res;
+      }
+      
+      /// Steal a task from the top, returns false if empty or if the steal failed
+      ///
+      /// Any thread can call this
+      bool steal(Task& task)
+      {
+	/// Current top
+	int64_t t=
+	  top.load(std::memory_order_acquire);
+	
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	
+	/// Current bottom
+	const int64_t b=
+	  bottom.load(std::memory_order_acquire);
+	
+	if(t>=b)
+	  return false;
+	
+	task=readSlot(t);
+	
+	return
+	  top.compare_exchange_strong(t,t+1,std::memory_order_seq_cst,std::memory_order_relaxed);
+      }
+    };
+    
+    /// Work-stealing scheduler
+    ///
+    /// All threads of the pool enter \c workerLoop, and leave it when
+    /// all spawned tasks have been completed
+    class WorkStealingScheduler
+    {
+      /// Queue of each thread
+      std::vector<WorkStealingDeque> deques;
+      
+      /// Number of tasks spawned and not yet completed
+      alignas(CACHE_LINE_SIZE) std::atomic<int64_t> nPendingTasks;
+      
+      /// Number of tasks stolen, for statistics
+      alignas(CACHE_LINE_SIZE) std::atomic<int64_t> nStolenTasks;
+      
+      /// Try to get a task, from the own queue first, then stealing
+      bool getTask(const int& threadId,
+		   uint64_t& seed,
+		   Task& task);
+    
+    public:
+      
+      /// Creates the scheduler for the given number of threads
+      WorkStealingScheduler(const int& nThreads);
+      
+      /// Spawn a task on the queue of the calling thread
+      ///
+      /// If the queue is full, the task is run directly
+      void spawn(const int& threadId,
+		 const Task& task);
+      
+      /// Prepare the execution of the root task, to be called by master before dispatching
+      void prepare(const Task& root);
+      
+      /// Loop over tasks, until all tasks have been completed
+      void workerLoop(const int& threadId);
+      
+      /// Number of tasks stolen so far
+      int64_t getNStolenTasks() const
+      {
+	return
+	  nStolenTasks.load(std::memory_order_relaxed);
+      }
+    };
+    
+    namespace resources
+    {
+      /// Work-stealing scheduler, created at first usage
+      EXTERN_WORK_STEALING WorkStealingScheduler* workStealingScheduler;
+    }
+    
+    /// Returns the work-stealing scheduler, creating it if needed
+    inline WorkStealingScheduler& workStealingScheduler()
+    {
+      if(resources::workStealingScheduler==nullptr)
+	resources::workStealingScheduler=
+	  new WorkStealingScheduler(nThreads);
+      
+      return
+	*resources::workStealingScheduler;
+    }
+    
+    /// Context passed to a running task, allowing to spawn subtasks
+    struct TaskContext
+    {
+      /// Thread running the task
+      const int threadId;
+      
+      /// Kernel currently being executed
+      const TaskKernel* const kernel;
+      
+      /// Spawn a subtask running the current kernel on the range [beg,end)
+      ///
+      /// The subtask is put on the queue of the running thread, and
+      /// can be stolen by idle threads
+      INLINE_FUNCTION
+      void spawn(const int64_t beg,
+		 const int64_t end)
+	const
+      {
+	workStealingScheduler().spawn(threadId,{kernel,beg,end});
+      }
+    };
+    
+    /// Run a kernel on [beg,end) as a task, using the work-stealing scheduler
+    ///
+    /// The object \a f must be callable with a \c TaskContext and
+    /// the range as int64_t, and can spawn subtasks through the
+    /// context. Differently from \c parallel, this returns only when
+    /// all the spawned tasks have been completed.
+    template <typename F>
+    void taskRun(const int64_t beg,  ///< Beginning of the root range
+		 const int64_t end,  ///< End of the root range
+		 const F& f)         ///< Kernel
+    {
+      /// Type-erased kernel, living until all tasks are completed
+      const TaskKernel kernel
+	{[](const void* obj,TaskContext& ctx,const int64_t beg,const int64_t end)
+	 {
+	   (*static_cast<const F*>(obj))(ctx,beg,end);
+	 },&f};
+      
+      /// Scheduler
+      WorkStealingScheduler& scheduler=
+	workStealingScheduler();
+	
+#ifdef USE_THREADS
+      waitThatAllWorkersWaitForWork();
+#endif
+      
+      scheduler.prepare({&kernel,beg,end});
+      
+#ifdef USE_THREADS
+      parallel([&scheduler](const int& threadId)
+	       {
+		 scheduler.workerLoop(threadId);
+	       });
+#else
+      scheduler.workerLoop(0);
+#endif
+    }
+    
+    /// Split a loop into tasks, executed with work stealing
+    ///
+    /// The range is recursively halved: each half above the \a grain
+    /// size is spawned as a subtask, so that idle threads can steal
+    /// it. This is more robust than \c loopSplit against uneven work
+    /// per iteration, at the price of some atomic operation per
+    /// task. Returns when the whole loop has been executed.
+    template <typename Size,           // Type for the range of the loop
+	      typename F>              // Type of the function
+    void loopSteal(const Size& beg,        ///< Beginning of the loop
+		   const Size& end,        ///< End of the loop
+		   F&& f,                  ///< Function to be called
+		   int64_t grain=0)        ///< Minimal size of a task, automatically chosen if 0
+    {
+      /// Length of the loop
+      const int64_t length=
+	(int64_t)end-(int64_t)beg;
+      
+      if(length<=0)
+	return;
+      
+      // Aim at a few tasks per thread
+      if(grain<=0)
+	grain=
+	  std::max<int64_t>(1,length/(8*nThreads));
+      
+      taskRun((int64_t)beg,(int64_t)end,
+	      [grain,&f](const TaskContext& ctx,int64_t taskBeg,int64_t taskEnd)
+	      {
+		// Spawn the upper half until the range is small enough
+		while(taskEnd-taskBeg>grain)
+		  {
+		    /// Middle point of the range
+		    const int64_t mid=
+		      taskBeg+(taskEnd-taskBeg)/2;
+		    
+		    ctx.spawn(mid,taskEnd);
+		    taskEnd=mid;
+		  }
+		
+		for(int64_t i=taskBeg;i<taskEnd;i++)
+		  f(static_cast<Size>(i));
+	      });
+    }
+  }
+}
+
+#undef EXTERN_WORK_STEALING
+
+#endif